@@ -1,6 +1,6 @@
 #!/bin/sh
 
-if [ ! -f ./confetti_unidata.c ]; then
+if [ ! -f ./confetti_unidata.c ] || [ ! -f ./confetti_unidata.h ]; then
     echo "Please run unicode.py first or build from the release tarball (instead of repo checkout) to skip this step."
     exit 1
 fi
@@ -25,6 +25,11 @@
 // simplify the API. Ideally, a more straightforward implementation could,
 // potentially, be only a few hundred lines of C, at most.
 
+// Memory mapping files requires POSIX interfaces which strict ISO C modes hide.
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "confetti.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +41,7 @@
 #include <stdint.h>
 #include <stdalign.h>
 #include <stddef.h>
+#include "confetti_unidata.h"
 
 // When gathering branch coverage, do not let untaken assert branches contribute negatively to
 // the metrics. Asserts are never supposed to fail so their branches will not be taken.
@@ -47,11 +53,63 @@
 // This is a workaround for Visual Studio's lack of support for max_align_t.
 #if defined(_MSC_VER)
 #define max_align_t 16
+#define MAX_ALIGNMENT 16
+#else
+#define MAX_ALIGNMENT alignof(max_align_t)
 #endif
 
-typedef uint32_t uchar; // Unicode scalar value.
+// Detect which vector instruction sets the scanning kernels can use. SSE2 is part of the
+// x86-64 baseline so it's nearly always available. The AVX2 and AVX-512 kernels are compiled
+// when CONFETTI_SIMD_DISPATCH is defined, or when the compiler was told it can target them
+// (e.g. with -mavx2 or -march=native), and are only used if the processor supports them.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#if defined(CONFETTI_SIMD_DISPATCH) && (defined(__x86_64__) || defined(_M_X64))
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define HAVE_AVX2 1
+#define HAVE_AVX512 1
+#endif
+#endif
+
+#if defined(__AVX2__) && !defined(HAVE_AVX2)
+#define HAVE_AVX2 1
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && !defined(HAVE_AVX512)
+#define HAVE_AVX512 1
+#endif
+
+#if defined(HAVE_AVX2) || defined(HAVE_AVX512)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(HAVE_SSE2)
+#include <intrin.h>
+#endif
+
+// Files are memory mapped where supported, otherwise they're read into a buffer.
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+// Kernels using instructions beyond those the compiler targets by default must be annotated
+// so the compiler permits them. Visual Studio permits any instruction without annotation.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
 
-uint8_t conf_uniflags(uint32_t cp);
+typedef uint32_t uchar; // Unicode scalar value.
 
 #define IS_FORBIDDEN_CHARACTER 0x1 // set of forbidden characters
 #define IS_SPACE_CHARACTER 0x2 // set of white space and new line characters
@@ -60,6 +118,11 @@ uint8_t conf_uniflags(uint32_t cp);
 #define IS_BIDI_CHARACTER 0x10 // set of bidirectional formatting characters
 #define IS_ESCAPABLE_CHARACTER (IS_ARGUMENT_CHARACTER | IS_PUNCTUATOR_CHARACTER)
 
+// These flags are not part of the Unicode table. They are assigned per configuration unit
+// depending on which extensions are enabled.
+#define IS_EXPRESSION_STARTER 0x20 // set of characters that begin an expression argument
+#define IS_PUNCTUATOR_STARTER 0x40 // set of characters that might begin a custom punctuator argument
+
 #define BAD_ENCODING 0x110000
 
 typedef enum token_type
@@ -76,6 +139,25 @@ typedef enum token_type
     TOK_RCURLYB = '}',
 } token_type;
 
+// Classifies the first byte of a token so the tokenizer can jump straight to the scanner for
+// it. Bytes that need more than their first byte to classify are handled as TOKEN_START_OTHER.
+typedef enum token_start
+{
+    TOKEN_START_OTHER,
+    TOKEN_START_END,
+    TOKEN_START_ARGUMENT,
+    TOKEN_START_WHITESPACE,
+    TOKEN_START_NEWLINE,
+    TOKEN_START_COMMENT,
+    TOKEN_START_SLASH, // Might begin a C style comment.
+    TOKEN_START_PUNCTUATOR,
+    TOKEN_START_BACKSLASH, // Might begin a line continuation.
+    TOKEN_START_EXPRESSION,
+    TOKEN_START_BRACE,
+    TOKEN_START_QUOTE,
+    TOKEN_START_SEMICOLON,
+} token_start;
+
 typedef enum token_flags
 {
     CONF_QUOTED = 0x1,
@@ -97,67 +179,194 @@ typedef struct token
     token_flags flags;
 } token;
 
-struct comment
+// Directives are stored in a single array where the subdirectives of each directive are
+// contiguous so they can be indexed directly. Likewise, arguments are stored in a single
+// array and their values in a single buffer.
+struct conf_directive
 {
-    conf_comment data;
-    struct comment *next;
+    const conf_directive *subdir;
+    const conf_argument *arguments;
+    long subdir_count;
+    long arguments_count;
 };
 
-struct conf_directive
+// While parsing, the directive and argument arrays are assembled in growable arrays that
+// can be moved as they grow, so they refer to each other by index. They are converted to
+// their public, pointer-based representation after parsing completes.
+struct tree_node
 {
-    long buffer_length;
+    size_t subdir; // Index of the first subdirective in the node array.
+    size_t arguments; // Index of the first argument in the argument array.
     long subdir_count;
     long arguments_count;
+};
 
-    conf_argument *arguments;
-    
-    conf_directive **subdir;
-    conf_directive *subdir_head;
-    conf_directive *subdir_tail;
-    conf_directive *next;
+struct tree_argument
+{
+    size_t value; // Offset of the value in the value buffer, or in the source text if it's a view.
+    size_t value_length;
+    size_t lexeme_offset;
+    size_t lexeme_length;
+    bool is_expression;
+    bool is_view; // True if the value is viewed in place in the source text.
+};
+
+// Comments are stored as they're found when the parse tree is built in a caller-provided buffer,
+// where they can't be collected in a growable array. The records are linked in reverse and are
+// copied to an exactly sized array once parsing completes.
+struct comment_record
+{
+    conf_comment comment;
+    size_t previous; // Offset of the previous record in the storage, or SIZE_MAX.
+};
+
+// Represents a set of ASCII bytes that end a run of bytes a scanning kernel can skip in bulk.
+// Bytes outside the ASCII range always end a run. The set is stored in multiple formats so
+// each kernel can test membership in the way best suited to its instruction set.
+struct stopset
+{
+    uint8_t bitmap[16]; // Bit N is set if ASCII byte N is a member.
+    uint8_t nibbles[16]; // Bit N of element M is set if byte (N << 4 | M) is a member.
+    uint8_t below; // Every byte less than this value is a member.
+    uint8_t count; // Number of members listed in the bytes array or STOPSET_UNLISTED.
+    uint8_t bytes[32]; // Members greater than or equal to the 'below' threshold.
+};
+
+#define STOPSET_UNLISTED 0xFF
 
-    char buffer[];
+// Represents a node in the trie of punctuator arguments. Each node corresponds to a byte
+// of one or more punctuators, and its children are the bytes which may follow it.
+struct trie_node
+{
+    uint32_t first_child; // Index of the first child node, or zero if there are none.
+    uint32_t next_sibling; // Index of the next node with the same parent, or zero if there are none.
+    uint8_t byte; // The byte that transitions from the parent node to this node.
+    bool terminal; // True if a punctuator ends at this node.
 };
 
-// Represents a set of punctuator arguments beginning with the same Unicode scalar value.
-struct punctset
+// Represents the syntax of a configuration unit compiled from its options: the scanning kernels
+// chosen for the processor and the tables specialized for the enabled extensions. It isn't
+// modified once it's compiled, so a compiled syntax can be shared by any number of units.
+struct conf_syntax
 {
-    size_t size; // The size, in bytes, of this structure in memory.
-    long length; // The total number of punctuators sharing the same starting character.
-    char punctuators[]; // List of punctuator strings delimited by a zero byte.
+    conf_extensions extensions;
+    const struct kernels *kernels; // Scanning kernels chosen for the processor.
+
+    // Punctuator arguments are compiled into a byte-level trie. The children of the root are
+    // found by their byte in the root table and the bitmap records which bytes have an entry
+    // so bytes that don't begin a punctuator are rejected with a single bit test. Node zero is
+    // never used so an index of zero means "no node".
+    struct trie_node *punctuator_trie;
+    size_t punctuator_trie_size;
+    uint32_t punctuator_root[256];
+    uint8_t punctuator_leads[32];
+
+    // Character flags for ASCII characters specialized with the flags of the enabled extensions.
+    // Characters outside the ASCII range have their Unicode flags combined with 'extended_flags'.
+    uint8_t ascii_flags[128];
+    uint8_t extended_flags;
+
+    // Maps the first byte of a token to its token_start classification.
+    uint8_t token_starts[256];
+
+    // ASCII bytes which can not be skipped over in bulk while scanning an unquoted argument.
+    // This depends on the enabled extensions, e.g. punctuator starters end a run of bytes.
+    struct stopset argument_stops;
+
+    // ASCII bytes which can not be skipped over in bulk while scanning a comment.
+    struct stopset comment_stops;
+    struct stopset multi_line_comment_stops;
+
+    // ASCII bytes which can not be skipped over in bulk while scanning a quoted argument.
+    struct stopset quoted_stops;
+
+    // Allocator the punctuator trie, and a syntax compiled by conf_syntax_compile(), belong to.
+    conf_allocfn allocator;
+    void *user_data;
 };
 
 struct conf_unit
 {
     const char *string; // Points to the beginning of the string being parsed.
     const char *needle; // Points to the current location being parsed.
-    
+    const char *end; // Points to the null terminator, or first null character, of the string being parsed.
+    const char *limit; // Points one past the last byte of the string being parsed.
+    const char *valid_end; // Points to the first malformed UTF-8 sequence or the null terminator.
+    size_t base; // Offset of 'string' within the source text, which is nonzero for streams.
+    char *insitu; // Writable alias of 'string' when argument values are unescaped in place.
+    bool streaming; // True if more source text might follow 'end', i.e. a stream isn't finished.
+    bool check_bidi; // True if bidirectional characters are forbidden and the source text might contain one.
+
     conf_walkfn walk;
     token peek; // Current, but processed token.
 
-    // The punctuator starters array is an array of Unicode scalar values where each scalar
-    // is a unique starting character amongst the set of punctuators. For example, if we
-    // have the punctuator set {'+', '+=', '-', '-='}, then this arrays length is two
-    // because we have two unique starting characters: '+' and '-'.
-    uchar *punctuator_starters;
-    size_t punctuator_starters_size;
-
-    // The punctuators array is an array of arrays, where each subarray contains punctuators
-    // that begin with the same Unicode scalar value (i.e. the same starter character).
-    struct punctset **punctuators;
-    long punctuators_count;
-
-    // Comments are tracked in a linked list when the source text is parsed, but then
-    // they are moved to an array for O(1) access time after parsing completes.
+    // The syntax the unit is parsed with. It's either compiled for the unit or copied from the
+    // syntax in its options, in which case the punctuator trie is shared rather than owned.
+    struct conf_syntax syntax;
+
+    // The caller-provided buffer conf_parse_into() builds the unit in. The parse tree is built in
+    // its final form from the low end of the buffer while the pending directives and argument
+    // tokens are stacked at its high end. Nothing is freed individually.
+    bool use_storage;
+    unsigned char *storage; // Null when the unit is only being measured.
+    size_t storage_capacity;
+    size_t storage_low; // Bytes used at the low end.
+    size_t storage_high; // Bytes used at the high end.
+    size_t storage_peak; // Most bytes used at once, which is what conf_measure() reports.
+    size_t storage_comments; // Offset of the most recently stored comment, or SIZE_MAX.
+
+    // True if the source text is only being measured for conf_measure(). The storage is used as
+    // it would be by conf_parse_into(), but without a buffer, so nothing is written to it.
+    bool measuring;
+    size_t measured_length; // Exact length of the values of the scanned arguments.
+
+    // Scratch buffer for the argument tokens of the directive being parsed.
+    token *tokens;
+    size_t tokens_count;
+    size_t tokens_capacity;
+
+    // Scratch buffers the arguments of a directive are copied to before they're reported. These
+    // are reused between directives so they only grow when a directive has more arguments, or
+    // longer values, than those before it.
+    conf_argument *argv;
+    size_t argv_capacity;
+    char *argv_values;
+    size_t argv_values_capacity;
+
+    // Scratch arrays the parse tree is assembled in. Directives are parsed depth first so the
+    // siblings of a directive being parsed are held on the 'pending' stack and they're moved to
+    // the node array, as a contiguous run, when their parent's body has been parsed.
+    struct tree_node *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    struct tree_node *tree_nodes;
+    size_t tree_nodes_count;
+    size_t tree_nodes_capacity;
+    struct tree_argument *tree_arguments;
+    size_t tree_arguments_count;
+    size_t tree_arguments_capacity;
+    char *tree_values;
+    size_t tree_values_length;
+    size_t tree_values_capacity;
+
+    // The parse tree in its final form.
+    conf_directive *directives;
+    size_t directives_count;
+    conf_argument *arguments;
+    size_t arguments_count;
+    char *values;
+    size_t values_length;
+
+    // Comments are collected in a growable array when the source text is parsed and are
+    // then copied to an exactly sized array alongside the parse tree.
+    conf_comment *tree_comments;
+    size_t tree_comments_count;
+    size_t tree_comments_capacity;
+    conf_comment *comments;
     long comments_count;
-    struct comment **comments;
-    struct comment *comment_head;
-    struct comment *comment_tail;
-    size_t comment_processed;
 
     // These are user-provided structures.
     conf_options options;
-    conf_extensions extensions;
 
     conf_directive *root;
 
@@ -167,7 +376,10 @@ struct conf_unit
     alignas(max_align_t) unsigned char padding[sizeof(conf_directive)];
 };
 
-static void parse_body(conf_unit *conf, conf_directive *parent, int depth);
+static void parse_body(conf_unit *conf, struct tree_node *parent, int depth);
+
+// Value passed to longjmp() when a stream needs more input to continue. Errors pass one.
+#define STREAM_SUSPENDED 2
 
 _Noreturn static void die(conf_unit *conf, conf_errno error, const char *where, const char *message, ...)
 {
@@ -175,7 +387,7 @@ _Noreturn static void die(conf_unit *conf, conf_errno error, const char *where,
     assert(where != NULL);
 
     conf->err.code = error;
-    conf->err.where = where - conf->string;
+    conf->err.where = conf->base + (size_t)(where - conf->string);
 
     va_list args;
     va_start(args, message);
@@ -190,6 +402,15 @@ _Noreturn static void die(conf_unit *conf, conf_errno error, const char *where,
     longjmp(conf->err_buf, 1);
 }
 
+// Unwinds to the stream that's being fed when a scanner looks past the input received so far.
+// The token is scanned again, from its beginning, once more input has arrived.
+_Noreturn static void suspend(conf_unit *conf)
+{
+    assert(conf != NULL);
+    assert(conf->streaming);
+    longjmp(conf->err_buf, STREAM_SUSPENDED);
+}
+
 static void *default_alloc(void *ud, void *ptr, size_t size)
 {
     assert(size > 0);
@@ -211,27 +432,117 @@ static void *new(conf_unit *conf, size_t size)
     return conf->options.allocator(conf->options.user_data, NULL, size);
 }
 
-static void *zero_new(conf_unit *conf, size_t size)
+static void delete(conf_unit *conf, void *ptr, size_t size)
 {
-    void *ptr = new(conf, size);
-    if (ptr != NULL)
+    assert(conf != NULL);
+    assert(ptr != NULL);
+    assert(size > 0);
+    if (!conf->use_storage)
     {
-        (void)memset(ptr, 0, size);
+        conf->options.allocator(conf->options.user_data, ptr, size);
     }
-    return ptr;
 }
 
-static void delete(conf_unit *conf, void *ptr, size_t size)
+// Returns an array with room for 'additional' more elements than 'count'. The array is moved
+// to a larger allocation, double the size of the previous allocation, when it's out of room.
+static void *grow_array(conf_unit *conf, void *array, size_t *capacity, size_t count, size_t additional, size_t element_size)
 {
     assert(conf != NULL);
-    assert(ptr != NULL);
-    assert(size > 0);
-    conf->options.allocator(conf->options.user_data, ptr, size);
+    assert(capacity != NULL);
+    assert(count <= *capacity);
+
+    if (additional <= *capacity - count)
+    {
+        return array;
+    }
+
+    size_t new_capacity = (*capacity == 0) ? 8 : *capacity;
+    while (new_capacity - count < additional)
+    {
+        if (new_capacity > (SIZE_MAX / 2) / element_size)
+        {
+            die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+        }
+        new_capacity *= 2;
+    }
+
+    void *new_array = new(conf, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+    }
+
+    if (array != NULL)
+    {
+        memcpy(new_array, array, count * element_size);
+        delete(conf, array, *capacity * element_size);
+    }
+    *capacity = new_capacity;
+    return new_array;
+}
+
+// Rounds an allocation size up so the allocation following it is maximally aligned.
+static size_t round_to_alignment(size_t size)
+{
+    return (size + MAX_ALIGNMENT - 1) & ~(MAX_ALIGNMENT - 1);
+}
+
+// Verifies the storage has room for 'size' more bytes and records the peak usage.
+static void storage_claim(conf_unit *conf, size_t size)
+{
+    assert(conf != NULL);
+    assert(conf->use_storage);
+
+    const size_t used = conf->storage_low + conf->storage_high;
+    if (size > conf->storage_capacity - used)
+    {
+        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "buffer too small");
+    }
+
+    if (used + size > conf->storage_peak)
+    {
+        conf->storage_peak = used + size;
+    }
+}
+
+// Carves memory from the low end of the storage and returns its offset. The most recent
+// allocation can be shrunk by resetting 'storage_low' past its new end.
+static size_t storage_new(conf_unit *conf, size_t size)
+{
+    if (size > SIZE_MAX - MAX_ALIGNMENT)
+    {
+        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "buffer too small");
+    }
+
+    size = round_to_alignment(size);
+    storage_claim(conf, size);
+    const size_t offset = conf->storage_low;
+    conf->storage_low += size;
+    return offset;
+}
+
+// Returns the address of the element at 'index' in the pending directive stack. The stack grows
+// down from the high end of the storage.
+static struct tree_node *storage_pending(conf_unit *conf, size_t index)
+{
+    assert(conf->storage != NULL);
+    return (struct tree_node *)(conf->storage + conf->storage_capacity) - (index + 1);
+}
+
+// Returns the address of the element at 'index' in the argument token stack, which is stacked
+// below the pending directives while the arguments of a directive are scanned.
+static token *storage_token(conf_unit *conf, size_t index)
+{
+    assert(conf->storage != NULL);
+    return (token *)(conf->storage + conf->storage_capacity - (sizeof(struct tree_node) * conf->pending_count)) - (index + 1);
 }
 
-static uchar utf8decode2(const char *utf8, size_t *utf8_length)
+// Decodes the UTF-8 sequence at 'utf8' without reading at, or past, 'end'. The end of the
+// text is reported as a null character and a sequence cut short by it is malformed.
+static uchar utf8decode2(const char *utf8, const char *end, size_t *utf8_length)
 {
     assert(utf8 != NULL);
+    assert(end != NULL);
 
     static const uint8_t bytes_needed_for_UTF8_sequence[] = {
         1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
@@ -299,7 +610,7 @@ static uchar utf8decode2(const char *utf8, size_t *utf8_length)
     }
 
     // Check for the end of the string.
-    if (bytes[0] == 0x0)
+    if (utf8 >= end || bytes[0] == 0x0)
     {
         return '\0';
     }
@@ -311,7 +622,11 @@ static uchar utf8decode2(const char *utf8, size_t *utf8_length)
         return BAD_ENCODING;
     }
 
-    // Check if the character ends prematurely due to a null terminator.
+    // Check if the character ends prematurely due to the end of the string.
+    if (end - utf8 < seqlen)
+    {
+        return BAD_ENCODING;
+    }
     for (int i = 1; i < seqlen; i++)
     {
         if (bytes[i] == '\0')
@@ -350,1596 +665,3832 @@ static uchar utf8decode2(const char *utf8, size_t *utf8_length)
     return BAD_ENCODING;
 }
 
-static uchar utf8decode(conf_unit *conf, const char *utf8, size_t *utf8_length)
+// Decodes a UTF-8 sequence that is known to be well-formed.
+static uchar utf8decode_trusted(const char *utf8, size_t *utf8_length)
 {
-    const uchar scalar = utf8decode2(utf8, utf8_length);
-    if (scalar == BAD_ENCODING)
+    assert(utf8 != NULL);
+
+    const uint8_t *bytes = (const uint8_t *)utf8;
+    uchar value;
+    size_t length;
+
+    if (bytes[0] < 0x80)
     {
-        die(conf, CONF_ILLEGAL_BYTE_SEQUENCE, utf8, "malformed UTF-8");
+        value = bytes[0];
+        length = 1;
     }
-    return scalar;
+    else if (bytes[0] < 0xE0)
+    {
+        value = (uchar)(bytes[0] & 0x1F) << 6 | (uchar)(bytes[1] & 0x3F);
+        length = 2;
+    }
+    else if (bytes[0] < 0xF0)
+    {
+        value = (uchar)(bytes[0] & 0x0F) << 12 | (uchar)(bytes[1] & 0x3F) << 6 | (uchar)(bytes[2] & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        value = (uchar)(bytes[0] & 0x07) << 18 | (uchar)(bytes[1] & 0x3F) << 12 | (uchar)(bytes[2] & 0x3F) << 6 | (uchar)(bytes[3] & 0x3F);
+        length = 4;
+    }
+
+    if (utf8_length != NULL)
+    {
+        *utf8_length = length;
+    }
+    return value;
 }
 
-static bool is_newline(conf_unit *conf, const char *string, size_t *length)
+// Returns the length of the UTF-8 sequence that begins with 'lead' assuming it's well-formed.
+static ptrdiff_t utf8_sequence_length(char lead)
 {
-    assert(conf != NULL);
-    assert(string != NULL);
-    assert(length != NULL);
-
-    if (strncmp(string, "\r\n", 2) == 0)
+    const uint8_t byte = (uint8_t)lead;
+    if (byte < 0xC0)
     {
-        *length = 2;
-        return true;
+        return 1;
     }
-    
-    switch (utf8decode(conf, string, length))
-    {
-    case 0x000A: // Line feed
-    case 0x000B: // Vertical tab
-    case 0x000C: // Form feed
-    case 0x000D: // Carriage return
-    case 0x0085: // Next line
-    case 0x2028: // Line separator
-    case 0x2029: // Paragraph separator
-        return true;
+    else if (byte < 0xE0)
+    {
+        return 2;
     }
-
-    return false;
+    else if (byte < 0xF0)
+    {
+        return 3;
+    }
+    return 4;
 }
 
-// Scan expression arguments is implemented using a "virtual" stack data structure.
-// When '(' is encountered, it's pushed, when ')' is encountered, it's popped.
-// When the stack is empty, the expression has been fully processed.
-static void scan_expression_argument(conf_unit *conf, const char *string, token *tok)
+// Text given with an explicit length ends at its first null character. If there's text after it,
+// then the null character is reported as soon as scanning reaches it rather than treated as the
+// end of the text, which would mislead with errors such as an unclosed block.
+static void check_null(conf_unit *conf, const char *at)
 {
-    assert(conf != NULL);
-    assert(string != NULL);
-    assert(string[0] == '(');
-    assert(tok != NULL);
+    if (at == conf->end && conf->end < conf->limit)
+    {
+        die(conf, CONF_BAD_SYNTAX, conf->end, "illegal character U+0000");
+    }
+}
 
-    const char *at = string + 1; // +1 to skip the opening '(' character
-    size_t stack = 1; // "push" an opening '(' character onto the "stack"
+static uchar utf8decode(conf_unit *conf, const char *utf8, size_t *utf8_length)
+{
+    // The source text preceding the first malformed sequence was validated before parsing began.
+    if (utf8 < conf->valid_end)
+    {
+        return utf8decode_trusted(utf8, utf8_length);
+    }
 
-    for (;;)
+    // A stream might have received only the beginning of the character so far.
+    if (conf->streaming && conf->end - utf8 < 4)
     {
-        if (at[0] == '\0')
-        {
-            die(conf, CONF_BAD_SYNTAX, string, "incomplete expression");
-        }
-        
-        if (at[0] == '(')
+        if (utf8 == conf->end || conf->end - utf8 < utf8_sequence_length(utf8[0]))
         {
-            stack += 1; // "push" a '(' character onto the stack
-            at += 1;
+            suspend(conf);
         }
-        else if (at[0] == ')')
-        {
-            stack -= 1; // "pop" a ')' character from the stack
-            at += 1;
+    }
+    check_null(conf, utf8);
 
-            // If the "stack" is empty, then the complete expression has been processed.
-            if (stack == 0)
-            {
-                break;
-            }
-        }
-        else
-        {
-            size_t length = 0;
-            const uchar cp = utf8decode(conf, at, &length);
+    const uchar scalar = utf8decode2(utf8, conf->end, utf8_length);
+    if (scalar == BAD_ENCODING)
+    {
+        die(conf, CONF_ILLEGAL_BYTE_SEQUENCE, utf8, "malformed UTF-8");
+    }
+    return scalar;
+}
 
-            if (conf_uniflags(cp) & IS_FORBIDDEN_CHARACTER)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
-            }
+// Checks if the source text contains a bidirectional formatting character. Every one of them is
+// encoded as a three byte sequence beginning with E2 80 or E2 81 so it's enough to search for
+// the lead byte and then inspect the bytes following it. The search is vectorized by the
+// C library so scanning for these characters one at a time is avoided if there are none.
+static bool contains_bidi(const char *string, const char *end)
+{
+    assert(string != NULL);
+    assert(end >= string);
 
-            if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+    const char *at = string;
+    while ((at = memchr(at, 0xE2, (size_t)(end - at))) != NULL)
+    {
+        const uint8_t *bytes = (const uint8_t *)at;
+        if (end - at >= 3 && (bytes[1] == 0x80 || bytes[1] == 0x81) && (bytes[2] & 0xC0) == 0x80)
+        {
+            const uchar cp = (uchar)(0x2000 | (bytes[1] & 0x3F) << 6 | (bytes[2] & 0x3F));
+            if (conf_charflags(cp) & IS_BIDI_CHARACTER)
             {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+                return true;
             }
-
-            at += length;
         }
+        at += 1;
     }
+    return false;
+}
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_ARGUMENT;
-    tok->flags = CONF_EXPRESSION;
-    tok->trim = 1;
+// Returns the flags of a character including the flags specific to the configuration unit.
+static uint8_t unit_charflags(const conf_unit *conf, uchar cp)
+{
+    if (cp < 0x80)
+    {
+        return conf->syntax.ascii_flags[cp];
+    }
+    return (uint8_t)(conf_uniflags(cp) | conf->syntax.extended_flags);
 }
 
-static void scan_triple_quoted_argument(conf_unit *conf, const char *string, token *tok)
+// Checks if 'at' is the end of the source text. If a stream has yet to receive the rest of the
+// text, then it's unknown whether this is the end so scanning is suspended until it's known.
+static bool at_end(conf_unit *conf, const char *at)
 {
-    const char *at = string;
-    size_t length;
+    assert(at <= conf->end);
+    if (at < conf->end)
+    {
+        return false;
+    }
+
+    if (conf->streaming)
+    {
+        suspend(conf);
+    }
+    check_null(conf, at);
+    return true;
+}
+
+// Returns the byte at 'at' or zero if 'at' is the end of the source text. Scanners use this to
+// look ahead without reading past the end of the text, which isn't null terminated when it's
+// given with an explicit length.
+static uint8_t byte_at(conf_unit *conf, const char *at)
+{
+    return at_end(conf, at) ? 0 : (uint8_t)at[0];
+}
 
+// Line terminators are recognized by their first byte. Only the multi-byte terminators, which
+// are NEL (C2 85), LS (E2 80 A8), and PS (E2 80 A9), require examining subsequent bytes.
+// Malformed UTF-8 is not diagnosed here; callers decode the character which reports it.
+static bool is_newline(conf_unit *conf, const char *string, size_t *length)
+{
     assert(conf != NULL);
     assert(string != NULL);
-    assert(tok != NULL);
-    assert((at[0] == '"') && (at[1] == '"') && (at[2] == '"'));
-
-    at += 3; // Skip the opening quote characters.
+    assert(length != NULL);
 
-    for (;;)
+    switch (byte_at(conf, string))
     {
-        // Check for the end of a triple quoted argument.
-        if ((at[0] == '"') && (at[1] == '"') && (at[2] == '"'))
-        {
-            at += 3;
-            break;
-        }
+    case 0x0D: // Carriage return
+        *length = (byte_at(conf, string + 1) == 0x0A) ? 2 : 1;
+        return true;
 
-        uchar cp = utf8decode(conf, at, &length);
-        if (cp == '\0')
+    case 0x0A: // Line feed
+    case 0x0B: // Vertical tab
+    case 0x0C: // Form feed
+        *length = 1;
+        return true;
+
+    case 0xC2:
+        if (byte_at(conf, string + 1) == 0x85) // Next line
         {
-            die(conf, CONF_BAD_SYNTAX, at, "unclosed quoted");
+            *length = 2;
+            return true;
         }
+        break;
 
-        if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+    case 0xE2:
+        if (byte_at(conf, string + 1) == 0x80 && (byte_at(conf, string + 2) == 0xA8 || byte_at(conf, string + 2) == 0xA9)) // Line or paragraph separator
         {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            *length = 3;
+            return true;
         }
+        break;
+    }
 
-        if (cp == '\\')
-        {
-            at += 1;
-            cp = utf8decode(conf, at, &length);
-            
-            if ((conf_uniflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
-            {
-                if (cp == 0 || is_newline(conf, at, &length))
-                {
-                    die(conf, CONF_BAD_SYNTAX, at, "incomplete escape sequence");
-                }
-                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
-            }
+    return false;
+}
 
-            if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
-            }
-        }
-        else
-        {
-            if (is_newline(conf, at, &length))
-            {
-                at += length;
-                continue;
-            }
-            else if ((conf_uniflags(cp) & (IS_ESCAPABLE_CHARACTER | IS_SPACE_CHARACTER)) == 0)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
-            }
-        }
-
-        at += length;
-    }
+//
+// The scanners process source text one Unicode scalar value at a time which is thorough, but
+// slow. Most configuration files are predominately ASCII so when a scanner is positioned on a
+// run of ASCII characters it hands the run to a kernel that skips past it in bulk. The kernel
+// stops at the first byte that needs closer inspection and the scanner resumes from there.
+//
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_ARGUMENT;
-    tok->flags = CONF_TRIPLE_QUOTED;
-    tok->trim = 3;
+static void stopset_add(struct stopset *set, uint8_t byte)
+{
+    assert(set != NULL);
+    assert(byte < 0x80);
+    set->bitmap[byte >> 3] |= (uint8_t)(1 << (byte & 0x7));
+    set->nibbles[byte & 0xF] |= (uint8_t)(1 << (byte >> 4));
 }
 
-static void scan_single_quoted_argument(conf_unit *conf, const char *string, token *tok)
+static bool stopset_contains(const struct stopset *set, uint8_t byte)
 {
-    const char *at = string;
-    size_t length;
-
-    assert(conf != NULL);
-    assert(string != NULL);
-    assert(tok != NULL);
-    assert(at[0] == '"');
-
-    at += 1; // Skip the opening quote character.
-
-    for (;;)
+    assert(set != NULL);
+    if (byte >= 0x80)
     {
-        uchar cp = utf8decode(conf, at, &length);
-
-        if (cp == '\0' || is_newline(conf, at, &length))
-        {
-            die(conf, CONF_BAD_SYNTAX, at, "unclosed quoted");
-        }
-
-        if (cp == '\\')
-        {
-            at += 1;
+        return true;
+    }
+    return (set->bitmap[byte >> 3] & (1 << (byte & 0x7))) != 0;
+}
 
-            // New lines after a backslash are ignored in single quoted arguments.
-            if (is_newline(conf, at, &length))
-            {
-                at += length;
-                continue;
-            }
+// Derives the list representation of the set. This must be called after all members are added.
+static void stopset_finalize(struct stopset *set)
+{
+    assert(set != NULL);
 
-            // Verify the backslash is followed by a legal character.
-            cp = utf8decode(conf, at, &length);
-            if ((conf_uniflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
-            {
-                if (cp == 0)
-                {
-                    die(conf, CONF_BAD_SYNTAX, at, "incomplete escape sequence");
-                }
-                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
-            }
+    // Find the first non-member byte. Every byte before it is matched with a single comparison.
+    uint8_t below = 0;
+    while (below < 0x7F && stopset_contains(set, below))
+    {
+        below += 1;
+    }
+    set->below = below;
+    set->count = 0;
 
-            if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
-            }
-        }
-        else
+    // List the remaining members so they can be matched individually.
+    for (int byte = below; byte < 0x80; byte++)
+    {
+        if (stopset_contains(set, (uint8_t)byte))
         {
-            if ((conf_uniflags(cp) & (IS_ESCAPABLE_CHARACTER | IS_SPACE_CHARACTER)) == 0)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
-            }
-
-            if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
-            {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
-            }
-
-            if (cp == '"')
+            if (set->count == sizeof(set->bytes))
             {
-                at += length;
+                set->count = STOPSET_UNLISTED; // Too many members to test for individually.
                 break;
             }
+            set->bytes[set->count++] = (uint8_t)byte;
         }
-        
-        at += length;
     }
+}
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_ARGUMENT;
-    tok->flags = CONF_QUOTED;
-    tok->trim = 1;
+static int lowest_set_bit(uint32_t mask)
+{
+    assert(mask != 0);
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int index = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        index += 1;
+    }
+    return index;
+#endif
+}
+
+#if defined(HAVE_AVX512)
+static int lowest_set_bit64(uint64_t mask)
+{
+    assert(mask != 0);
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
 }
+#endif
+
+//
+// Each kernel has a scalar implementation and, where the instruction set helps, vectorized
+// implementations. The widest implementation supported by the processor is chosen at runtime
+// when the configuration unit is initialized. Wider implementations finish the trailing bytes
+// of the source text with the next narrower implementation.
+//
+// All implementations return a pointer to the first byte, at or after 'at', that is a member
+// of the stop set or lies outside the ASCII range. If there is no such byte, then the end of
+// the source text is returned. The kernels never read past the end of the source text.
+//
 
-static bool scan_punctuator_argument(conf_unit *conf, const char *string, token *tok, uchar starter)
+static const char *skip_ascii_run_scalar(const conf_unit *conf, const char *at, const struct stopset *set)
 {
     assert(conf != NULL);
-    assert(conf->punctuators_count > 0);
-    assert(string != NULL);
-    assert(tok != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
+    assert(set != NULL);
 
-    size_t longest_match = 0;
-    for (long i = 0; i < conf->punctuators_count; i++)
+    while (at < conf->end)
     {
-        if (conf->punctuator_starters[i] != starter)
+        if (stopset_contains(set, (uint8_t)at[0]))
         {
-            continue;
-        }
-
-        size_t buffer_offset = 0;
-        const struct punctset *set = conf->punctuators[i];
-        for (long i = 0; i < set->length; i++)
-        {
-            const char *punctuator = &set->punctuators[buffer_offset];
-            const size_t punctuator_length = strlen(punctuator);
-            if (punctuator_length >= longest_match)
-            {
-                if (strncmp(string, punctuator, punctuator_length) == 0)
-                {
-                    tok->lexeme = string - conf->string;
-                    tok->lexeme_length =  punctuator_length;
-                    tok->type = TOK_ARGUMENT;
-                    tok->flags = 0;
-                    tok->trim = 0;
-                    longest_match = punctuator_length;    
-                }
-            }
-            buffer_offset += punctuator_length + 1;
+            break;
         }
+        at += 1;
     }
-
-    if (longest_match > 0)
-    {
-        return true;
-    }
-    return false;
+    return at;
 }
 
-static void scan_argument(conf_unit *conf, const char *string, token *tok)
+#if defined(HAVE_SSE2)
+static const char *skip_ascii_run_sse2(const conf_unit *conf, const char *at, const struct stopset *set)
 {
-    const char *at = string;
-    size_t length;
-
     assert(conf != NULL);
-    assert(string != NULL);
-    assert(tok != NULL);
-    
-    for (;;)
+    assert(at != NULL);
+    assert(at <= conf->end);
+    assert(set != NULL);
+
+    // Classify 16 bytes at a time by comparing them against each listed member of the set.
+    // Bytes outside the ASCII range are negative when compared as signed integers so they are
+    // matched by the same comparison as the bytes below the threshold.
+    if (set->count != STOPSET_UNLISTED)
     {
-        uchar cp = utf8decode(conf, at, &length);
-        if (cp == '\\')
+        const __m128i below = _mm_set1_epi8((char)set->below);
+        while (conf->end - at >= 16)
         {
-            at += 1;
-            cp = utf8decode(conf, at, &length);
-
-            if ((conf_uniflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
+            const __m128i block = _mm_loadu_si128((const __m128i *)at);
+            __m128i hits = _mm_cmplt_epi8(block, below);
+            for (int i = 0; i < set->count; i++)
             {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8((char)set->bytes[i])));
             }
 
-            if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+            const uint32_t stops = (uint32_t)_mm_movemask_epi8(hits);
+            if (stops != 0)
             {
-                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+                return at + lowest_set_bit(stops);
             }
-
-            at += length;
-            continue;
+            at += 16;
         }
+    }
 
-        if ((conf_uniflags(cp) & IS_ARGUMENT_CHARACTER) == 0)
-        {
-            break;
-        }
+    return skip_ascii_run_scalar(conf, at, set);
+}
+#endif
 
-        if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+#if defined(HAVE_AVX2)
+TARGET_AVX2
+static const char *skip_ascii_run_avx2(const conf_unit *conf, const char *at, const struct stopset *set)
+{
+    assert(conf != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
+    assert(set != NULL);
+
+    // Classify 32 bytes at a time. Each byte is split into its high and low nibble which are
+    // used as indices into two lookup tables; a byte is a member of the set if the bits selected
+    // by both nibbles overlap. This tests membership in a fixed number of steps for any set.
+    const __m256i nibbles = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->nibbles));
+    const __m256i high_bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    while (conf->end - at >= 32)
+    {
+        const __m256i block = _mm256_loadu_si256((const __m256i *)at);
+        const __m256i lo = _mm256_shuffle_epi8(nibbles, _mm256_and_si256(block, low_nibble));
+        const __m256i hi = _mm256_shuffle_epi8(high_bits, _mm256_and_si256(_mm256_srli_epi16(block, 4), low_nibble));
+        const __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+
+        // The most significant bit of each byte is set for bytes outside the ASCII range.
+        const uint32_t stops = ~(uint32_t)_mm256_movemask_epi8(misses) | (uint32_t)_mm256_movemask_epi8(block);
+        if (stops != 0)
         {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            return at + lowest_set_bit(stops);
         }
+        at += 32;
+    }
 
-        // If the expression arguments extension is enabled, then do
-        // not consider it part of this argument.
-        if (conf->extensions.expression_arguments && cp == '(')
-        {
-            break;
-        }
+    return skip_ascii_run_sse2(conf, at, set);
+}
+#endif
 
-        // If the punctuator arguments extension is enabled, then check if
-        // the current character is the start of one. If so, then do not
-        // interpret it as part of this extension argument.
-        if (conf->punctuators_count > 0)
+#if defined(HAVE_AVX512)
+TARGET_AVX512
+static const char *skip_ascii_run_avx512(const conf_unit *conf, const char *at, const struct stopset *set)
+{
+    assert(conf != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
+    assert(set != NULL);
+
+    // This is the same nibble lookup as the AVX2 kernel, but 64 bytes at a time.
+    const __m512i nibbles = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)set->nibbles));
+    const __m512i high_bits = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m512i low_nibble = _mm512_set1_epi8(0x0F);
+    while (conf->end - at >= 64)
+    {
+        const __m512i block = _mm512_loadu_si512((const void *)at);
+        const __m512i lo = _mm512_shuffle_epi8(nibbles, _mm512_and_si512(block, low_nibble));
+        const __m512i hi = _mm512_shuffle_epi8(high_bits, _mm512_and_si512(_mm512_srli_epi16(block, 4), low_nibble));
+        const uint64_t stops = (uint64_t)_mm512_test_epi8_mask(lo, hi) | (uint64_t)_mm512_movepi8_mask(block);
+        if (stops != 0)
         {
-            if (scan_punctuator_argument(conf, at, tok, cp))
-            {
-                break;
-            }
+            return at + lowest_set_bit64(stops);
         }
-
-        at += length;
+        at += 64;
     }
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_ARGUMENT;
-    tok->flags = 0;
-    tok->trim = 0;
+    return skip_ascii_run_avx2(conf, at, set);
 }
+#endif
 
-static void scan_whitespace(conf_unit *conf, const char *string, token *tok)
+// Unlike the other kernels, these return a pointer to the first byte, at or after 'at', that
+// is neither a space nor a tab character.
+static const char *skip_blanks_scalar(const conf_unit *conf, const char *at)
 {
     assert(conf != NULL);
-    assert(string != NULL);
-    assert(tok != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
 
-    const char *at = string;
-    for (;;)
+    while (at < conf->end && (at[0] == ' ' || at[0] == '\t'))
     {
-        size_t length;
-        const uchar cp = utf8decode(conf, at, &length);
-        if (conf_uniflags(cp) & IS_SPACE_CHARACTER)
+        at += 1;
+    }
+    return at;
+}
+
+#if defined(HAVE_SSE2)
+static const char *skip_blanks_sse2(const conf_unit *conf, const char *at)
+{
+    assert(conf != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
+
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (conf->end - at >= 16)
+    {
+        const __m128i block = _mm_loadu_si128((const __m128i *)at);
+        const __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs));
+        const uint32_t stops = ~(uint32_t)_mm_movemask_epi8(blanks) & UINT32_C(0xFFFF);
+        if (stops != 0)
         {
-            at += length;
-            continue;
+            return at + lowest_set_bit(stops);
         }
-        break;
+        at += 16;
     }
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_WHITESPACE;
-    tok->flags = 0;
-    tok->trim = 0;
+    return skip_blanks_scalar(conf, at);
 }
+#endif
 
-static void scan_single_line_comment(conf_unit *conf, const char *string, token *tok)
+#if defined(HAVE_AVX2)
+TARGET_AVX2
+static const char *skip_blanks_avx2(const conf_unit *conf, const char *at)
 {
     assert(conf != NULL);
-    assert(string != NULL);
-    assert(string[0] == '#' || (string[0] == '/' && string[1] == '/'));
-    assert(tok != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
 
-    const char *at = string;
-    for (;;)
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (conf->end - at >= 32)
     {
-        if (*at == '\0')
+        const __m256i block = _mm256_loadu_si256((const __m256i *)at);
+        const __m256i blanks = _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs));
+        const uint32_t stops = ~(uint32_t)_mm256_movemask_epi8(blanks);
+        if (stops != 0)
         {
-            break;
+            return at + lowest_set_bit(stops);
         }
+        at += 32;
+    }
 
-        size_t length = 0;
-        if (is_newline(conf, at, &length))
-        {
-            break;
-        }
+    return skip_blanks_sse2(conf, at);
+}
+#endif
 
-        length = 0;
-        const uchar cp = utf8decode(conf, at, &length);
-        if (conf_uniflags(cp) & IS_FORBIDDEN_CHARACTER)
-        {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal character");
-        }
+#if defined(HAVE_AVX512)
+TARGET_AVX512
+static const char *skip_blanks_avx512(const conf_unit *conf, const char *at)
+{
+    assert(conf != NULL);
+    assert(at != NULL);
+    assert(at <= conf->end);
 
-        if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+    const __m512i spaces = _mm512_set1_epi8(' ');
+    const __m512i tabs = _mm512_set1_epi8('\t');
+    while (conf->end - at >= 64)
+    {
+        const __m512i block = _mm512_loadu_si512((const void *)at);
+        const uint64_t blanks = (uint64_t)_mm512_cmpeq_epi8_mask(block, spaces) | (uint64_t)_mm512_cmpeq_epi8_mask(block, tabs);
+        if (blanks != UINT64_MAX)
         {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            return at + lowest_set_bit64(~blanks);
         }
-
-        at += length;
+        at += 64;
     }
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_COMMENT;
-    tok->flags = 0;
-    tok->trim = 0;
+    return skip_blanks_avx2(conf, at);
 }
+#endif
 
-static void scan_multi_line_comment(conf_unit *conf, const char *string, token *tok)
+// These return a pointer to the first malformed UTF-8 sequence at or after 'at', or 'end' if the
+// text is well-formed. The 'at' pointer must be on a character boundary. Sequences are delimited
+// from there, so the result is where a scanner decoding one character after another would
+// encounter the error.
+static const char *validate_utf8_scalar(const char *at, const char *end)
 {
-    assert(conf != NULL);
-    assert(string != NULL);
-    assert(string[0] == '/' && string[1] == '*');
-    assert(tok != NULL);
+    assert(at != NULL);
+    assert(end >= at);
 
-    const char *at = string;
-    for (;;)
+    while (at < end)
     {
-        if (*at == '\0')
+        if ((uint8_t)at[0] < 0x80)
         {
-            die(conf, CONF_BAD_SYNTAX, string, "unterminated multi-line comment");
+            at += 1;
+            continue;
         }
 
-        if (at[0] == '*' && at[1] == '/')
+        size_t length;
+        if (utf8decode2(at, end, &length) == BAD_ENCODING)
         {
-            at += 2;
             break;
         }
+        at += length;
+    }
+    return at;
+}
 
-        size_t length = 0;
-        const uchar cp = utf8decode(conf, at, &length);
-        if (conf_uniflags(cp) & IS_FORBIDDEN_CHARACTER)
+#if defined(HAVE_SSE2)
+static const char *validate_utf8_sse2(const char *at, const char *end)
+{
+    assert(at != NULL);
+    assert(end >= at);
+
+    while (at < end)
+    {
+        // Skip blocks of ASCII characters, which are all valid.
+        if (end - at >= 16)
         {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+            const uint32_t non_ascii = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)at));
+            if (non_ascii == 0)
+            {
+                at += 16;
+                continue;
+            }
+            at += lowest_set_bit(non_ascii);
         }
 
-        if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+        if ((uint8_t)at[0] < 0x80)
         {
-            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            at += 1;
+            continue;
         }
 
+        size_t length;
+        if (utf8decode2(at, end, &length) == BAD_ENCODING)
+        {
+            break;
+        }
         at += length;
     }
+    return at;
+}
+#endif
+
+#if defined(HAVE_AVX2)
+// Loads a 16-entry lookup table into both 128-bit lanes, which is what the shuffle instruction expects.
+TARGET_AVX2
+static __m256i broadcast_table(const uint8_t table[16])
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table));
+}
+
+// Validates 32 bytes of UTF-8 using the lookup algorithm by John Keiser and Daniel Lemire, see
+// "Validating UTF-8 In Less Than One Instruction Per Byte". Each pair of adjacent bytes is
+// classified by three 4-bit lookups whose results are intersected to detect every error that
+// can be seen in two bytes. The third and fourth bytes of a sequence are checked separately.
+TARGET_AVX2
+static __m256i utf8check32(__m256i block, __m256i previous_block)
+{
+    enum
+    {
+        TOO_SHORT = 1 << 0, // 11______ 0_______ or 11______ 11______
+        TOO_LONG = 1 << 1, // 0_______ 10______
+        OVERLONG_3 = 1 << 2, // 11100000 100_____
+        TOO_LARGE = 1 << 3, // 11110100 1001____ and above
+        SURROGATE = 1 << 4, // 11101101 101_____
+        OVERLONG_2 = 1 << 5, // 1100000_ 10______
+        TOO_LARGE_1000 = 1 << 6, // 11110101 1000____ and above
+        OVERLONG_4 = 1 << 6, // 11110000 1000____
+        TWO_CONTS = 1 << 7, // 10______ 10______
+        CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+    };
+
+    static const uint8_t byte_1_high_table[16] = {
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, // 0_______
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, // 10______
+        TOO_SHORT | OVERLONG_2, // 1100____
+        TOO_SHORT, // 1101____
+        TOO_SHORT | OVERLONG_3 | SURROGATE, // 1110____
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4, // 1111____
+    };
+
+    static const uint8_t byte_1_low_table[16] = {
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, // ____0000
+        CARRY | OVERLONG_2, // ____0001
+        CARRY, // ____0010
+        CARRY, // ____0011
+        CARRY | TOO_LARGE, // ____0100
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____0101
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____0110
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____0111
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1000
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1001
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1010
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1011
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1100
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, // ____1101
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1110
+        CARRY | TOO_LARGE | TOO_LARGE_1000, // ____1111
+    };
+
+    static const uint8_t byte_2_high_table[16] = {
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, // 0_______
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, // 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, // 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, // 1010____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, // 1011____
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, // 11______
+    };
+
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    // Shift the block right by N bytes, shifting in the trailing bytes of the previous block.
+    const __m256i carried = _mm256_permute2x128_si256(previous_block, block, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(block, carried, 16 - 1);
+    const __m256i prev2 = _mm256_alignr_epi8(block, carried, 16 - 2);
+    const __m256i prev3 = _mm256_alignr_epi8(block, carried, 16 - 3);
+
+    const __m256i byte_1_high = _mm256_shuffle_epi8(broadcast_table(byte_1_high_table), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+    const __m256i byte_1_low = _mm256_shuffle_epi8(broadcast_table(byte_1_low_table), _mm256_and_si256(prev1, low_nibble));
+    const __m256i byte_2_high = _mm256_shuffle_epi8(broadcast_table(byte_2_high_table), _mm256_and_si256(_mm256_srli_epi16(block, 4), low_nibble));
+    const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Bytes following a three or four byte lead byte must be continuation bytes. These are
+    // exactly the positions where the lookups above report two consecutive continuation bytes.
+    const __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    const __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    const __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_be_continuation, special_cases);
+}
+#endif
+
+#if defined(HAVE_AVX2)
+TARGET_AVX2
+static const char *validate_utf8_avx2(const char *at, const char *end)
+{
+    assert(at != NULL);
+    assert(end >= at);
+
+    const char *start = at;
+
+    // Validate 32 bytes at a time until a block with an error is found. Multi-byte sequences
+    // straddling two blocks are checked against the trailing bytes of the previous block.
+    __m256i previous_block = _mm256_setzero_si256();
+    while (end - at >= 32)
+    {
+        const __m256i block = _mm256_loadu_si256((const __m256i *)at);
+        const __m256i errors = utf8check32(block, previous_block);
+        if (!_mm256_testz_si256(errors, errors))
+        {
+            break;
+        }
+        previous_block = block;
+        at += 32;
+    }
+
+    // Every preceding byte is valid, except for a sequence that might be incomplete at the block
+    // boundary. It must begin within the last three bytes so resume from the first character
+    // boundary among them; this way the exact location of any error is found.
+    const char *boundary = (at - start > 3) ? at - 3 : start;
+    while (boundary < at && ((uint8_t)boundary[0] & 0xC0) == 0x80)
+    {
+        boundary += 1;
+    }
+    return validate_utf8_sse2(boundary, end);
+}
+#endif
+
+// The set of kernels chosen for a configuration unit.
+struct kernels
+{
+    const char *(*skip_ascii_run)(const conf_unit *conf, const char *at, const struct stopset *set);
+    const char *(*skip_blanks)(const conf_unit *conf, const char *at);
+    const char *(*validate_utf8)(const char *at, const char *end);
+};
+
+static const struct kernels scalar_kernels = {
+    skip_ascii_run_scalar, skip_blanks_scalar, validate_utf8_scalar,
+};
+
+#if defined(HAVE_SSE2)
+static const struct kernels sse2_kernels = {
+    skip_ascii_run_sse2, skip_blanks_sse2, validate_utf8_sse2,
+};
+#endif
+
+#if defined(HAVE_AVX2)
+static const struct kernels avx2_kernels = {
+    skip_ascii_run_avx2, skip_blanks_avx2, validate_utf8_avx2,
+};
+#endif
+
+#if defined(HAVE_AVX512)
+// There is no AVX-512 UTF-8 validator; the AVX2 validator is used instead.
+static const struct kernels avx512_kernels = {
+    skip_ascii_run_avx512, skip_blanks_avx512, validate_utf8_avx2,
+};
+#endif
+
+#if defined(HAVE_AVX2) || defined(HAVE_AVX512)
+enum instruction_set
+{
+    ISA_AVX2,
+    ISA_AVX512, // The F and BW subsets.
+};
+
+// Checks if the processor, and the operating system, support the given instruction set.
+static bool cpu_supports(enum instruction_set isa)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (isa == ISA_AVX512)
+    {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The operating system must save the vector registers across context switches.
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave)
+    {
+        return false;
+    }
+    const unsigned long long xcr0 = _xgetbv(0);
+
+    __cpuidex(info, 7, 0);
+    if (isa == ISA_AVX512)
+    {
+        const bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0; // AVX512F and AVX512BW
+        return avx512 && (xcr0 & 0xE6) == 0xE6;
+    }
+    const bool avx2 = (info[1] & (1 << 5)) != 0;
+    return avx2 && (xcr0 & 0x6) == 0x6;
+#else
+    return false;
+#endif
+}
+#endif
+
+// Chooses the widest kernels the processor supports unless the scalar kernels were requested,
+// either by the options or the environment. The scalar kernels are useful for debugging as
+// their behavior does not depend on the machine.
+static const struct kernels *select_kernels(const conf_options *options)
+{
+    if (options->force_scalar)
+    {
+        return &scalar_kernels;
+    }
+
+    const char *force_scalar = getenv("CONFETTI_FORCE_SCALAR");
+    if (force_scalar != NULL && force_scalar[0] != '\0' && strcmp(force_scalar, "0") != 0)
+    {
+        return &scalar_kernels;
+    }
+
+#if defined(HAVE_AVX512)
+    if (cpu_supports(ISA_AVX512))
+    {
+        return &avx512_kernels;
+    }
+#endif
+
+#if defined(HAVE_AVX2)
+    if (cpu_supports(ISA_AVX2))
+    {
+        return &avx2_kernels;
+    }
+#endif
+
+#if defined(HAVE_SSE2)
+    return &sse2_kernels;
+#else
+    return &scalar_kernels;
+#endif
+}
+
+static const char *skip_ascii_run(const conf_unit *conf, const char *at, const struct stopset *set)
+{
+    return conf->syntax.kernels->skip_ascii_run(conf, at, set);
+}
+
+static const char *skip_blanks(const conf_unit *conf, const char *at)
+{
+    return conf->syntax.kernels->skip_blanks(conf, at);
+}
+
+// Scan expression arguments is implemented using a "virtual" stack data structure.
+// When '(' is encountered, it's pushed, when ')' is encountered, it's popped.
+// When the stack is empty, the expression has been fully processed.
+static void scan_expression_argument(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(string[0] == '(');
+    assert(tok != NULL);
+
+    const char *at = string + 1; // +1 to skip the opening '(' character
+    size_t stack = 1; // "push" an opening '(' character onto the "stack"
+
+    for (;;)
+    {
+        const uint8_t byte = byte_at(conf, at);
+        if (byte == '\0')
+        {
+            die(conf, CONF_BAD_SYNTAX, string, "incomplete expression");
+        }
+        
+        if (byte == '(')
+        {
+            stack += 1; // "push" a '(' character onto the stack
+            at += 1;
+        }
+        else if (byte == ')')
+        {
+            stack -= 1; // "pop" a ')' character from the stack
+            at += 1;
+
+            // If the "stack" is empty, then the complete expression has been processed.
+            if (stack == 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            size_t length = 0;
+            const uchar cp = utf8decode(conf, at, &length);
+
+            if (conf_charflags(cp) & IS_FORBIDDEN_CHARACTER)
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+            }
+
+            if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            }
+
+            at += length;
+        }
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_ARGUMENT;
+    tok->flags = CONF_EXPRESSION;
+    tok->trim = 1;
+}
+
+static void scan_triple_quoted_argument(conf_unit *conf, const char *string, token *tok)
+{
+    const char *at = string;
+    size_t length;
+
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+    assert((byte_at(conf, at) == '"') && (byte_at(conf, at + 1) == '"') && (byte_at(conf, at + 2) == '"'));
+
+    at += 3; // Skip the opening quote characters.
+
+    for (;;)
+    {
+        at = skip_ascii_run(conf, at, &conf->syntax.quoted_stops);
+
+        // Check for the end of a triple quoted argument.
+        if ((byte_at(conf, at) == '"') && (byte_at(conf, at + 1) == '"') && (byte_at(conf, at + 2) == '"'))
+        {
+            at += 3;
+            break;
+        }
+
+        uchar cp = utf8decode(conf, at, &length);
+        if (cp == '\0')
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "unclosed quoted");
+        }
+
+        if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+        }
+
+        if (cp == '\\')
+        {
+            at += 1;
+            cp = utf8decode(conf, at, &length);
+            
+            if ((conf_charflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
+            {
+                if (cp == 0 || is_newline(conf, at, &length))
+                {
+                    die(conf, CONF_BAD_SYNTAX, at, "incomplete escape sequence");
+                }
+                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
+            }
+
+            if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            }
+        }
+        else
+        {
+            if (is_newline(conf, at, &length))
+            {
+                at += length;
+                continue;
+            }
+            else if ((conf_charflags(cp) & (IS_ESCAPABLE_CHARACTER | IS_SPACE_CHARACTER)) == 0)
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+            }
+        }
+
+        at += length;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_ARGUMENT;
+    tok->flags = CONF_TRIPLE_QUOTED;
+    tok->trim = 3;
+}
+
+static void scan_single_quoted_argument(conf_unit *conf, const char *string, token *tok)
+{
+    const char *at = string;
+    size_t length;
+
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+    assert(at[0] == '"');
+
+    at += 1; // Skip the opening quote character.
+
+    for (;;)
+    {
+        at = skip_ascii_run(conf, at, &conf->syntax.quoted_stops);
+
+        uchar cp = utf8decode(conf, at, &length);
+
+        if (cp == '\0' || is_newline(conf, at, &length))
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "unclosed quoted");
+        }
+
+        if (cp == '\\')
+        {
+            at += 1;
+
+            // New lines after a backslash are ignored in single quoted arguments.
+            if (is_newline(conf, at, &length))
+            {
+                at += length;
+                continue;
+            }
+
+            // Verify the backslash is followed by a legal character.
+            cp = utf8decode(conf, at, &length);
+            if ((conf_charflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
+            {
+                if (cp == 0)
+                {
+                    die(conf, CONF_BAD_SYNTAX, at, "incomplete escape sequence");
+                }
+                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
+            }
+
+            if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            }
+        }
+        else
+        {
+            if ((conf_charflags(cp) & (IS_ESCAPABLE_CHARACTER | IS_SPACE_CHARACTER)) == 0)
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+            }
+
+            if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            }
+
+            if (cp == '"')
+            {
+                at += length;
+                break;
+            }
+        }
+        
+        at += length;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_ARGUMENT;
+    tok->flags = CONF_QUOTED;
+    tok->trim = 1;
+}
+
+static bool scan_punctuator_argument(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(conf->syntax.punctuator_trie != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+
+    const uint8_t *bytes = (const uint8_t *)string;
+    if ((conf->syntax.punctuator_leads[bytes[0] >> 3] & (1 << (bytes[0] & 0x7))) == 0)
+    {
+        return false;
+    }
+
+    // Walk the trie for as long as the source text matches, remembering the last node where
+    // a punctuator ended; this is the longest matching punctuator. The walk always ends at the
+    // end of the source text, if not sooner, since no punctuator contains a zero byte.
+    const struct trie_node *trie = conf->syntax.punctuator_trie;
+    uint32_t node = conf->syntax.punctuator_root[bytes[0]];
+    size_t longest_match = 0;
+    size_t depth = 1;
+    while (node != 0)
+    {
+        if (trie[node].terminal)
+        {
+            longest_match = depth;
+        }
+
+        uint32_t child = trie[node].first_child;
+        const uint8_t byte = byte_at(conf, string + depth);
+        while (child != 0 && trie[child].byte != byte)
+        {
+            child = trie[child].next_sibling;
+        }
+        node = child;
+        depth += 1;
+    }
+
+    if (longest_match > 0)
+    {
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = longest_match;
+        tok->type = TOK_ARGUMENT;
+        tok->flags = 0;
+        tok->trim = 0;
+        return true;
+    }
+    return false;
+}
+
+static void scan_argument(conf_unit *conf, const char *string, token *tok)
+{
+    const char *at = string;
+    size_t length;
+
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+    
+    for (;;)
+    {
+        // Skip past plain ASCII argument characters in bulk. Only the character the kernel
+        // stops at needs to be decoded and classified.
+        at = skip_ascii_run(conf, at, &conf->syntax.argument_stops);
+
+        uchar cp = utf8decode(conf, at, &length);
+        if (cp == '\\')
+        {
+            at += 1;
+            cp = utf8decode(conf, at, &length);
+
+            if ((conf_charflags(cp) & IS_ESCAPABLE_CHARACTER) == 0)
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal escape character");
+            }
+
+            if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+            {
+                die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+            }
+
+            at += length;
+            continue;
+        }
+
+        const uint8_t flags = unit_charflags(conf, cp);
+        if ((flags & IS_ARGUMENT_CHARACTER) == 0)
+        {
+            break;
+        }
+
+        if (conf->check_bidi && (flags & IS_BIDI_CHARACTER))
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+        }
+
+        // If the expression arguments extension is enabled, then do
+        // not consider it part of this argument.
+        if (flags & IS_EXPRESSION_STARTER)
+        {
+            break;
+        }
+
+        // If the punctuator arguments extension is enabled, then check if
+        // the current character is the start of one. If so, then do not
+        // interpret it as part of this extension argument.
+        if (flags & IS_PUNCTUATOR_STARTER)
+        {
+            if (scan_punctuator_argument(conf, at, tok))
+            {
+                break;
+            }
+        }
+
+        at += length;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_ARGUMENT;
+    tok->flags = 0;
+    tok->trim = 0;
+}
+
+static void scan_whitespace(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+
+    const char *at = string;
+    for (;;)
+    {
+        // Indentation consists of spaces and tabs so skip past them in bulk.
+        // Other white space characters are decoded and classified individually.
+        at = skip_blanks(conf, at);
+
+        size_t length;
+        const uchar cp = utf8decode(conf, at, &length);
+        if (conf_charflags(cp) & IS_SPACE_CHARACTER)
+        {
+            at += length;
+            continue;
+        }
+        break;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_WHITESPACE;
+    tok->flags = 0;
+    tok->trim = 0;
+}
+
+static void scan_single_line_comment(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(string[0] == '#' || (string[0] == '/' && byte_at(conf, string + 1) == '/'));
+    assert(tok != NULL);
+
+    const char *at = string;
+    for (;;)
+    {
+        // Skip past printable ASCII characters in bulk. The kernel stops at control characters,
+        // which includes the single byte line terminators, and at the lead byte of multi-byte
+        // characters so they can be validated below.
+        at = skip_ascii_run(conf, at, &conf->syntax.comment_stops);
+
+        if (at_end(conf, at))
+        {
+            break;
+        }
+
+        size_t length = 0;
+        if (is_newline(conf, at, &length))
+        {
+            break;
+        }
+
+        length = 0;
+        const uchar cp = utf8decode(conf, at, &length);
+        if (conf_charflags(cp) & IS_FORBIDDEN_CHARACTER)
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+        }
+
+        if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+        }
+
+        at += length;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_COMMENT;
+    tok->flags = 0;
+    tok->trim = 0;
+}
+
+static void scan_multi_line_comment(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(string[0] == '/' && byte_at(conf, string + 1) == '*');
+    assert(tok != NULL);
+
+    const char *at = string;
+    for (;;)
+    {
+        // Skip past printable ASCII characters in bulk. The kernel stops at asterisks, since
+        // they might end the comment, as well as at control and multi-byte characters.
+        at = skip_ascii_run(conf, at, &conf->syntax.multi_line_comment_stops);
+
+        if (at_end(conf, at))
+        {
+            die(conf, CONF_BAD_SYNTAX, string, "unterminated multi-line comment");
+        }
+
+        if (at[0] == '*' && byte_at(conf, at + 1) == '/')
+        {
+            at += 2;
+            break;
+        }
+
+        size_t length = 0;
+        const uchar cp = utf8decode(conf, at, &length);
+        if (conf_charflags(cp) & IS_FORBIDDEN_CHARACTER)
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal character");
+        }
+
+        if (conf->check_bidi && (conf_charflags(cp) & IS_BIDI_CHARACTER))
+        {
+            die(conf, CONF_BAD_SYNTAX, at, "illegal bidirectional character");
+        }
+
+        at += length;
+    }
+
+    tok->lexeme = string - conf->string;
+    tok->lexeme_length = at - string;
+    tok->type = TOK_COMMENT;
+    tok->flags = 0;
+    tok->trim = 0;
+}
+
+// Scans a token that could not be classified by its first byte alone. This tries each kind of
+// token in turn which is slower, but necessary for multi-byte characters and the rare cases
+// where the first byte is ambiguous.
+static void scan_other_token(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+
+    if (is_newline(conf, string, &tok->lexeme_length))
+    {
+        tok->type = TOK_NEWLINE;
+        tok->lexeme = string - conf->string;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+    }
+
+    const uchar cp = utf8decode(conf, string, NULL);
+    const uint8_t flags = unit_charflags(conf, cp);
+    if (flags & IS_SPACE_CHARACTER)
+    {
+        scan_whitespace(conf, string, tok);
+        return;
+    }
+
+    if (conf->check_bidi && (flags & IS_BIDI_CHARACTER))
+    {
+        die(conf, CONF_BAD_SYNTAX, string, "illegal bidirectional character");
+    }
+
+    if (flags & IS_PUNCTUATOR_STARTER)
+    {
+        if (scan_punctuator_argument(conf, string, tok))
+        {
+            return;
+        }
+    }
+
+    if (flags & IS_EXPRESSION_STARTER)
+    {
+        scan_expression_argument(conf, string, tok);
+        return;
+    }
+
+    if ((string[0] == '{') || (string[0] == '}'))
+    {
+        tok->type = (token_type)string[0];
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 1;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+    }
+    
+    if (string[0] == '"')
+    {
+        if ((byte_at(conf, string + 1) == '"') && (byte_at(conf, string + 2) == '"'))
+        {
+            scan_triple_quoted_argument(conf, string, tok);
+        }
+        else
+        {
+            scan_single_quoted_argument(conf, string, tok);
+        }
+        return;
+    }
+
+    if (string[0] == ';')
+    {
+        tok->type = TOK_SEMICOLON;
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 1;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+    }
+
+    if (string[0] == '\\')
+    {
+        size_t length;
+        if (is_newline(conf, &string[1], &length))
+        {
+            tok->type = TOK_CONTINUATION;
+            tok->lexeme = string - conf->string;
+            tok->lexeme_length = length + 1;
+            tok->flags = 0;
+            tok->trim = 0;
+            return;
+        }
+    }
+
+    if (flags & IS_ARGUMENT_CHARACTER)
+    {
+        scan_argument(conf, string, tok);
+        return;
+    }
+
+    // For compatibility with source code editing tools that add end-of-file markers, if the last character
+    // of the compilation unit is a Control-Z character (U+001A), this character is deleted.
+    if (string[0] == 0x1A && at_end(conf, string + 1))
+    {
+        tok->type = TOK_EOF;
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 0;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+    }
+
+    if (cp == 0x0)
+    {
+        tok->type = TOK_EOF;
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 0;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+    }
+    
+    die(conf, CONF_BAD_SYNTAX, string, "illegal character U+%04X", cp);
+}
+
+static void scan_token(conf_unit *conf, const char *string, token *tok)
+{
+    assert(conf != NULL);
+    assert(string != NULL);
+    assert(tok != NULL);
+
+    switch ((token_start)conf->syntax.token_starts[byte_at(conf, string)])
+    {
+    case TOKEN_START_ARGUMENT:
+        scan_argument(conf, string, tok);
+        return;
+
+    case TOKEN_START_WHITESPACE:
+        scan_whitespace(conf, string, tok);
+        return;
+
+    case TOKEN_START_NEWLINE:
+        is_newline(conf, string, &tok->lexeme_length);
+        tok->type = TOK_NEWLINE;
+        tok->lexeme = string - conf->string;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+
+    case TOKEN_START_COMMENT:
+        scan_single_line_comment(conf, string, tok);
+        return;
+
+    case TOKEN_START_SLASH:
+        // Check for a C style single line comment, e.g. "// this is a commment"
+        if (byte_at(conf, string + 1) == '/')
+        {
+            scan_single_line_comment(conf, string, tok);
+            return;
+        }
+
+        // Check for a C style multi-line comment, e.g. "/* this is a commment */"
+        if (byte_at(conf, string + 1) == '*')
+        {
+            scan_multi_line_comment(conf, string, tok);
+            return;
+        }
+        break;
+
+    case TOKEN_START_PUNCTUATOR:
+        if (scan_punctuator_argument(conf, string, tok))
+        {
+            return;
+        }
+        // Punctuators consist of argument characters so the byte is either the beginning
+        // of a line continuation or an argument.
+        // fall through
+
+    case TOKEN_START_BACKSLASH:
+        if (string[0] == '\\')
+        {
+            size_t length;
+            if (is_newline(conf, &string[1], &length))
+            {
+                tok->type = TOK_CONTINUATION;
+                tok->lexeme = string - conf->string;
+                tok->lexeme_length = length + 1;
+                tok->flags = 0;
+                tok->trim = 0;
+                return;
+            }
+        }
+        scan_argument(conf, string, tok);
+        return;
+
+    case TOKEN_START_EXPRESSION:
+        scan_expression_argument(conf, string, tok);
+        return;
+
+    case TOKEN_START_BRACE:
+        tok->type = (token_type)string[0];
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 1;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+
+    case TOKEN_START_QUOTE:
+        if ((byte_at(conf, string + 1) == '"') && (byte_at(conf, string + 2) == '"'))
+        {
+            scan_triple_quoted_argument(conf, string, tok);
+        }
+        else
+        {
+            scan_single_quoted_argument(conf, string, tok);
+        }
+        return;
+
+    case TOKEN_START_SEMICOLON:
+        tok->type = TOK_SEMICOLON;
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 1;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+
+    case TOKEN_START_END:
+        tok->type = TOK_EOF;
+        tok->lexeme = string - conf->string;
+        tok->lexeme_length = 0;
+        tok->flags = 0;
+        tok->trim = 0;
+        return;
+
+    case TOKEN_START_OTHER:
+        break;
+    }
+
+    scan_other_token(conf, string, tok);
+}
+
+static void record_comment(conf_unit *unit, const conf_comment *data)
+{
+    if (unit->use_storage)
+    {
+        const size_t offset = storage_new(unit, sizeof(struct comment_record));
+        if (!unit->measuring)
+        {
+            struct comment_record *record = (struct comment_record *)(unit->storage + offset);
+            record->comment = *data;
+            record->previous = unit->storage_comments;
+        }
+        unit->storage_comments = offset;
+        unit->tree_comments_count += 1;
+        return;
+    }
+
+    unit->tree_comments = grow_array(unit, unit->tree_comments, &unit->tree_comments_capacity, unit->tree_comments_count, 1, sizeof(unit->tree_comments[0]));
+    unit->tree_comments[unit->tree_comments_count++] = *data;
+}
+
+static token_type peek(conf_unit *unit, token *tok)
+{
+    assert(unit != NULL);
+    assert(tok != NULL);
+
+    if (unit->peek.type == TOK_INVALID)
+    {
+        for (;;)
+        {
+            scan_token(unit, unit->needle, &unit->peek);
+            if (unit->peek.type == TOK_WHITESPACE)
+            {
+                unit->needle += unit->peek.lexeme_length;
+                continue;
+            }
+            else if (unit->peek.type == TOK_COMMENT)
+            {
+                if (unit->options.discard_comments)
+                {
+                    unit->needle += unit->peek.lexeme_length;
+                    continue;
+                }
+
+                const conf_comment comment = {
+                    .offset = unit->base + unit->peek.lexeme,
+                    .length = unit->peek.lexeme_length,
+                };
+                if (unit->walk == NULL)
+                {
+                    record_comment(unit, &comment);
+                }
+                else if (unit->walk(unit->options.user_data, CONF_COMMENT, 0, NULL, &comment) != 0)
+                {
+                    die(unit, CONF_USER_ABORTED, unit->needle, "user aborted");
+                }
+                unit->needle += unit->peek.lexeme_length;
+                continue;
+            }
+            break;
+        }
+    }
+    *tok = unit->peek;
+    return unit->peek.type;
+}
+
+static token_type eat(conf_unit *conf, token *tok)
+{
+    assert(conf != NULL);
+    assert(tok != NULL);
+
+    peek(conf, tok);
+    conf->needle += tok->lexeme_length;
+    conf->peek.type = TOK_INVALID;
+    return tok->type;
+}
+
+// Copies the value of a token to 'dest' and returns its length. The scanner has validated the
+// lexeme so only backslashes need attention: the run of bytes preceding each one is copied as a
+// whole and then the escaped character, if any, is copied after it.
+static size_t copy_token_to_buffer(conf_unit *conf, char *dest, const token *tok)
+{
+    assert(conf != NULL);
+    assert(tok != NULL);
+
+    const char *stop_offset = &conf->string[tok->lexeme + tok->lexeme_length];
+    const char *offset = &conf->string[tok->lexeme];
+    size_t nbytes = 0;
+
+    // Discard the N surrounding characters (e.g. quotes in a quoted literal).
+    offset += tok->trim;
+    stop_offset -= tok->trim;
+
+    while (offset < stop_offset)
+    {
+        const char *backslash = memchr(offset, '\\', (size_t)(stop_offset - offset));
+        const size_t run_length = (size_t)(((backslash != NULL) ? backslash : stop_offset) - offset);
+        if (dest != NULL)
+        {
+            // The destination trails the source when a value is unescaped in place.
+            memmove(&dest[nbytes], offset, run_length);
+        }
+        nbytes += run_length;
+
+        if (backslash == NULL)
+        {
+            break;
+        }
+        offset = backslash + 1; // skip the backslash
+
+        // New lines after a backslash are ignored in single quoted arguments.
+        size_t length;
+        if ((tok->flags & CONF_QUOTED) && is_newline(conf, offset, &length))
+        {
+            offset += length;
+            continue;
+        }
+
+        // The escaped character is copied as-is, which might itself be a backslash.
+        length = (size_t)utf8_sequence_length(offset[0]);
+        if (dest != NULL)
+        {
+            memmove(&dest[nbytes], offset, length);
+        }
+        offset += length;
+        nbytes += length;
+    }
+
+    return nbytes;
+}
+
+// Checks if the value of an argument is its lexeme, less any enclosing quotes, which is the case
+// when it contains no escape sequences or line continuations. With the argument views option
+// such values are viewed in place rather than copied.
+static bool is_viewable(const conf_unit *conf, const token *tok)
+{
+    assert(conf != NULL);
+    assert(tok != NULL);
+
+    if (!conf->options.argument_views)
+    {
+        return false;
+    }
+
+    const char *value = &conf->string[tok->lexeme + tok->trim];
+    return memchr(value, '\\', tok->lexeme_length - (tok->trim * 2)) == NULL;
+}
+
+// Directive arguments are parsed in a single pass: they are scanned into a token buffer, which
+// is owned by the configuration unit and reused between directives, while the number of bytes
+// needed to store their values is tallied. Storage for the arguments is then reserved with a
+// single allocation and the values are copied from the buffered tokens without re-scanning them.
+//
+// The tally is an upper bound on the storage needed rather than its exact size: escaped
+// characters lose their backslash when they're copied, but determining how many backslashes
+// were dropped would mean decoding every token twice.
+
+// Appends an argument token to the token buffer and returns the number of bytes needed to store
+// its value.
+static size_t push_token(conf_unit *conf, const token *tok)
+{
+    assert(conf != NULL);
+    assert(tok != NULL);
+    assert(tok->lexeme_length >= tok->trim * 2);
+
+    if (conf->use_storage)
+    {
+        // The tokens are stacked at the high end of the storage. When measuring, there's nowhere
+        // to stack them, so the exact length of the value is tallied instead.
+        storage_claim(conf, sizeof(token));
+        conf->storage_high += sizeof(token);
+        if (conf->measuring)
+        {
+            conf->measured_length += is_viewable(conf, tok) ? 0 : copy_token_to_buffer(conf, NULL, tok) + 1;
+        }
+        else
+        {
+            *storage_token(conf, conf->tokens_count) = *tok;
+        }
+        conf->tokens_count += 1;
+    }
+    else
+    {
+        conf->tokens = grow_array(conf, conf->tokens, &conf->tokens_capacity, conf->tokens_count, 1, sizeof(conf->tokens[0]));
+        conf->tokens[conf->tokens_count++] = *tok;
+    }
+    return tok->lexeme_length - (tok->trim * 2) + 1; // +1 for null byte
+}
+
+// Scans the arguments of a directive into the token buffer and returns the number of bytes
+// needed to store their values. The token following the last argument is returned in 'tok'.
+static size_t scan_arguments(conf_unit *conf, token *tok)
+{
+    assert(conf != NULL);
+    assert(tok != NULL);
+
+    size_t buffer_length = 0;
+    conf->tokens_count = 0;
+    conf->measured_length = 0;
+    for (;;)
+    {
+        peek(conf, tok);
+        if (tok->type == TOK_ARGUMENT)
+        {
+            buffer_length += push_token(conf, tok);
+            eat(conf, tok);
+        }
+        else if (tok->type == TOK_CONTINUATION)
+        {
+            eat(conf, tok);
+        }
+        else
+        {
+            break;
+        }
+    }
+    return buffer_length;
+}
+
+// Copies the values of the argument tokens to 'buffer' and describes them in 'argv'. Returns the
+// number of bytes copied to 'buffer'.
+static size_t copy_arguments(conf_unit *conf, const token *tokens, conf_argument *argv, char *buffer)
+{
+    assert(conf != NULL);
+    assert(tokens != NULL);
+    assert(argv != NULL);
+    assert(buffer != NULL);
+
+    const char *start = buffer;
+    for (size_t i = 0; i < conf->tokens_count; i++)
+    {
+        const token *tok = &tokens[i];
+        conf_argument *arg = &argv[i];
+        arg->lexeme_offset = conf->base + tok->lexeme;
+        arg->lexeme_length = tok->lexeme_length;
+        arg->is_expression = (tok->flags & CONF_EXPRESSION) ? true : false;
+        if (is_viewable(conf, tok))
+        {
+            arg->value = &conf->string[tok->lexeme + tok->trim];
+            arg->value_length = tok->lexeme_length - (tok->trim * 2);
+            continue;
+        }
+        arg->value = buffer;
+        arg->value_length = copy_token_to_buffer(conf, buffer, tok);
+        buffer += arg->value_length;
+        *buffer++ = '\0';
+    }
+    return (size_t)(buffer - start);
+}
+
+// Unescapes the value of an argument over its lexeme in the source text and null terminates it,
+// if possible, for conf_parse_insitu(). The terminator is written over the closing quote of a
+// quoted argument or over a byte dropped by unescaping. Otherwise it's written over the byte
+// following the lexeme, but only if that byte separates tokens; those bytes have been scanned
+// already, whereas an adjacent argument or comment must be left intact.
+static bool unescape_in_place(conf_unit *conf, const token *tok, size_t *value_length)
+{
+    assert(conf != NULL);
+    assert(conf->insitu != NULL);
+    assert(tok != NULL);
+    assert(value_length != NULL);
+
+    char *value = &conf->insitu[tok->lexeme];
+    *value_length = copy_token_to_buffer(conf, value, tok);
+    if (*value_length < tok->lexeme_length)
+    {
+        value[*value_length] = '\0';
+        return true;
+    }
+
+    switch (value[*value_length])
+    {
+    case '\0':
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\v':
+    case '\f':
+    case '\r':
+    case ';':
+    case '{':
+    case '}':
+        value[*value_length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+// Appends the arguments in the token buffer, and their values, to the scratch arrays the parse
+// tree is assembled in. Returns the index of the first argument.
+static size_t append_arguments(conf_unit *conf, size_t buffer_length)
+{
+    const size_t argc = conf->tokens_count;
+    conf->tree_arguments = grow_array(conf, conf->tree_arguments, &conf->tree_arguments_capacity, conf->tree_arguments_count, argc, sizeof(conf->tree_arguments[0]));
+    conf->tree_values = grow_array(conf, conf->tree_values, &conf->tree_values_capacity, conf->tree_values_length, buffer_length, sizeof(conf->tree_values[0]));
+
+    const size_t first = conf->tree_arguments_count;
+    for (size_t i = 0; i < argc; i++)
+    {
+        const token *arg_tok = &conf->tokens[i];
+        struct tree_argument *arg = &conf->tree_arguments[conf->tree_arguments_count++];
+        arg->lexeme_offset = arg_tok->lexeme;
+        arg->lexeme_length = arg_tok->lexeme_length;
+        arg->is_expression = (arg_tok->flags & CONF_EXPRESSION) ? true : false;
+        arg->is_view = (conf->insitu != NULL) ? unescape_in_place(conf, arg_tok, &arg->value_length) : is_viewable(conf, arg_tok);
+        if (conf->insitu != NULL && arg->is_view)
+        {
+            arg->value = arg_tok->lexeme;
+            continue;
+        }
+        else if (conf->insitu != NULL)
+        {
+            // The value was unescaped in place, but it couldn't be terminated there.
+            arg->value = conf->tree_values_length;
+            memcpy(&conf->tree_values[arg->value], &conf->insitu[arg_tok->lexeme], arg->value_length);
+            conf->tree_values_length += arg->value_length;
+            conf->tree_values[conf->tree_values_length++] = '\0';
+            continue;
+        }
+        else if (arg->is_view)
+        {
+            arg->value = arg_tok->lexeme + arg_tok->trim;
+            arg->value_length = arg_tok->lexeme_length - (arg_tok->trim * 2);
+            continue;
+        }
+        arg->value = conf->tree_values_length;
+        arg->value_length = copy_token_to_buffer(conf, &conf->tree_values[conf->tree_values_length], arg_tok);
+        conf->tree_values_length += arg->value_length;
+        conf->tree_values[conf->tree_values_length++] = '\0';
+    }
+    return first;
+}
+
+// Stores the arguments stacked in the storage, and their values, in their final form. Room for
+// the upper bound on the length of the values is claimed and then the allocation is shrunk to
+// their exact length. Returns the offset of the first argument.
+static size_t store_arguments(conf_unit *conf, size_t buffer_length)
+{
+    const size_t argc = conf->tokens_count;
+    if (argc > (SIZE_MAX - buffer_length) / sizeof(conf_argument))
+    {
+        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "buffer too small");
+    }
+
+    const size_t offset = storage_new(conf, sizeof(conf_argument) * argc + buffer_length);
+    size_t values_length = conf->measured_length;
+    if (!conf->measuring)
+    {
+        // The tokens were stacked downward, so they're reversed to put them in order.
+        token *tokens = storage_token(conf, argc - 1);
+        for (size_t i = 0; i < argc / 2; i++)
+        {
+            const token tmp = tokens[i];
+            tokens[i] = tokens[argc - 1 - i];
+            tokens[argc - 1 - i] = tmp;
+        }
+
+        conf_argument *argv = (conf_argument *)(conf->storage + offset);
+        values_length = copy_arguments(conf, tokens, argv, (char *)&argv[argc]);
+    }
+    conf->storage_low = offset + round_to_alignment(sizeof(conf_argument) * argc + values_length);
+    conf->storage_high -= sizeof(token) * argc;
+    return offset;
+}
+
+static void parse_directive(conf_unit *conf, int depth)
+{
+    assert(conf != NULL);
+    assert(depth >= 0);
+
+    token tok;
+    const size_t buffer_length = scan_arguments(conf, &tok);
+
+    // Copy the arguments and their values to the parse tree.
+    struct tree_node node = {
+        .arguments = conf->use_storage ? store_arguments(conf, buffer_length) : append_arguments(conf, buffer_length),
+        .arguments_count = (long)conf->tokens_count,
+    };
+
+    // Check for an optional, terminating semicolon.
+    if (tok.type == ';')
+    {
+        eat(conf, &tok); // consume ';'
+    }
+    else
+    {
+        // Consume as many new lines as possible.
+        while (tok.type == TOK_NEWLINE)
+        {
+            eat(conf, &tok);
+            peek(conf, &tok);
+        }
+
+        // Check for an optional subdirective.
+        if (tok.type == '{')
+        {
+            eat(conf, &tok); // consume '{'
+            parse_body(conf, &node, depth + 1);
+
+            peek(conf, &tok);
+            if (tok.type == '}')
+            {
+                eat(conf, &tok); // consume '}'
+                peek(conf, &tok);
+            }
+            else
+            {
+                die(conf, CONF_BAD_SYNTAX, conf->needle, "expected '}'");
+            }
+
+            // Check for an optional, terminating semicolon.
+            if (tok.type == ';')
+            {
+                eat(conf, &tok); // consume ';'
+            }
+        }
+    }
+
+    // The subdirectives of this directive have been moved off the stack, so it can be pushed
+    // onto the stack alongside its siblings.
+    if (conf->use_storage)
+    {
+        storage_claim(conf, sizeof(node));
+        conf->storage_high += sizeof(node);
+        if (!conf->measuring)
+        {
+            *storage_pending(conf, conf->pending_count) = node;
+        }
+        conf->pending_count += 1;
+        return;
+    }
+    conf->pending = grow_array(conf, conf->pending, &conf->pending_capacity, conf->pending_count, 1, sizeof(conf->pending[0]));
+    conf->pending[conf->pending_count++] = node;
+}
+
+// Copies the arguments in the token buffer to the scratch buffers and returns them. They remain
+// valid until the next directive's arguments are copied.
+static const conf_argument *buffer_arguments(conf_unit *conf, size_t buffer_length)
+{
+    assert(conf != NULL);
+
+    conf->argv = grow_array(conf, conf->argv, &conf->argv_capacity, 0, conf->tokens_count, sizeof(conf->argv[0]));
+    conf->argv_values = grow_array(conf, conf->argv_values, &conf->argv_values_capacity, 0, buffer_length, sizeof(conf->argv_values[0]));
+    (void)copy_arguments(conf, conf->tokens, conf->argv, conf->argv_values);
+    return conf->argv;
+}
+
+// Reports the directive whose arguments are in the token buffer to the walk callback. The arguments
+// are copied to the scratch buffers so walking makes no allocations once they've grown large enough.
+static void walk_arguments(conf_unit *conf, size_t buffer_length)
+{
+    assert(conf != NULL);
+    assert(conf->walk != NULL);
+
+    const int argc = (int)conf->tokens_count;
+    const conf_argument *argv = buffer_arguments(conf, buffer_length);
+    if (conf->walk(conf->options.user_data, CONF_DIRECTIVE, argc, argv, NULL) != 0)
+    {
+        die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+    }
+}
+
+static void walk_directive(conf_unit *conf, int depth)
+{
+    assert(conf != NULL);
+    assert(depth >= 0);
+
+    token tok;
+    walk_arguments(conf, scan_arguments(conf, &tok));
+
+    // Check for an optional, terminating semicolon.
+    if (tok.type == ';')
+    {
+        eat(conf, &tok); // consume ';'
+        return;
+    }
+
+    // Consume as many new lines as possible.
+    while (tok.type == TOK_NEWLINE)
+    {
+        eat(conf, &tok);
+        peek(conf, &tok);
+    }
+
+    // Check for an optional subdirective.
+    if (tok.type == '{')
+    {
+        eat(conf, &tok); // consume '{'
+
+        int r = conf->walk(conf->options.user_data, CONF_BLOCK_ENTER, 0, NULL, NULL);
+        if (r != 0)
+        {
+            die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+        }
+
+        parse_body(conf, NULL, depth + 1);
+
+        peek(conf, &tok);
+        if (tok.type == '}')
+        {
+            eat(conf, &tok); // consume '}'
+            peek(conf, &tok);
+
+            r = conf->walk(conf->options.user_data, CONF_BLOCK_LEAVE, 0, NULL, NULL);
+            if (r != 0)
+            {
+                die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+            }
+        }
+        else
+        {
+            die(conf, CONF_BAD_SYNTAX, conf->needle, "expected '}'");
+        }
+
+        // Check for a terminating semicolon.
+        if (tok.type == ';')
+        {
+            eat(conf, &tok); // consume ';'
+        }
+    }
+}
+
+// Stores the subdirectives on the pending stack, from 'mark' up, in their final form as a
+// contiguous run and pops them off the stack. Their arguments and subdirectives are already
+// stored, so the offsets recorded in their nodes are converted to pointers.
+static void store_subdirectives(conf_unit *conf, struct tree_node *parent, size_t mark)
+{
+    const size_t subdirs_count = conf->pending_count - mark;
+    const size_t offset = storage_new(conf, sizeof(conf_directive) * subdirs_count);
+    if (!conf->measuring)
+    {
+        conf_directive *subdirs = (conf_directive *)(conf->storage + offset);
+        for (size_t i = 0; i < subdirs_count; i++)
+        {
+            const struct tree_node *node = storage_pending(conf, mark + i);
+            subdirs[i] = (conf_directive){
+                .subdir = (const conf_directive *)(conf->storage + node->subdir),
+                .arguments = (const conf_argument *)(conf->storage + node->arguments),
+                .subdir_count = node->subdir_count,
+                .arguments_count = node->arguments_count,
+            };
+        }
+    }
+    parent->subdir = offset;
+    parent->subdir_count = (long)subdirs_count;
+    conf->storage_high -= sizeof(struct tree_node) * subdirs_count;
+    conf->pending_count = mark;
+}
+
+// Directive lists are parsed in a single pass and collected on the stack of pending directives.
+// After parsing is complete, the directives are moved from the stack to the node array where
+// they're stored contiguously for O(1) access.
+static void parse_body(conf_unit *conf, struct tree_node *parent, int depth)
+{
+    assert(conf != NULL);
+    assert(depth >= 0);
+
+    // Check if the maxmimum nesting depth has been exceeded.
+    if (depth >= conf->options.max_depth)
+    {
+        die(conf, CONF_MAX_DEPTH_EXCEEDED, conf->needle, "maximum nesting depth exceeded");
+    }
+
+    // Parse all subdirectives onto the stack.
+    const size_t mark = conf->pending_count;
+    for (;;)
+    {
+        token tok;
+        if (peek(conf, &tok) == TOK_EOF)
+        {
+            break;
+        }
+
+        if (tok.type == TOK_ARGUMENT)
+        {
+            if (parent == NULL)
+            {
+                walk_directive(conf, depth);
+                assert(conf->walk != NULL);
+            }
+            else
+            {
+                parse_directive(conf, depth);
+                assert(conf->walk == NULL);
+            }
+            continue;
+        }
+
+        if (tok.type == TOK_NEWLINE)
+        {
+            eat(conf, &tok);
+            continue;
+        }
+
+        // Check for a subdirective terminator.
+        // This will be handled by the caller.
+        if (tok.type == '}')
+        {
+            break;
+        }
+
+        if (tok.type == TOK_CONTINUATION)
+        {
+            die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected line continuation");
+        }
+
+        assert((tok.type == ';') || (tok.type == '{'));
+        die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected '%c'", tok.type);
+    }
+
+    if (parent != NULL && conf->use_storage)
+    {
+        store_subdirectives(conf, parent, mark);
+    }
+    else if (parent != NULL)
+    {
+        // Move the subdirectives from the stack to the node array.
+        const size_t subdirs_count = conf->pending_count - mark;
+        conf->tree_nodes = grow_array(conf, conf->tree_nodes, &conf->tree_nodes_capacity, conf->tree_nodes_count, subdirs_count, sizeof(conf->tree_nodes[0]));
+        if (subdirs_count > 0)
+        {
+            memcpy(&conf->tree_nodes[conf->tree_nodes_count], &conf->pending[mark], sizeof(conf->pending[0]) * subdirs_count);
+        }
+        parent->subdir = conf->tree_nodes_count;
+        parent->subdir_count = (long)subdirs_count;
+        conf->tree_nodes_count += subdirs_count;
+        conf->pending_count = mark;
+    }
+}
+
+const conf_directive *conf_get_directive(const conf_directive *dir, long index)
+{
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    if (index < 0 || index >= dir->subdir_count)
+    {
+        return NULL;
+    }
+    return &dir->subdir[index];
+}
+
+long conf_get_directive_count(const conf_directive *dir)
+{
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    return dir->subdir_count;
+}
+
+const conf_directive *conf_get_root(const conf_unit *unit)
+{
+    if (unit == NULL)
+    {
+        return NULL;
+    }
+    return unit->root;
+}
+
+const conf_argument *conf_get_argument(const conf_directive *dir, long index)
+{
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    if (index < 0 || index >= dir->arguments_count)
+    {
+        return NULL;
+    }
+    return &dir->arguments[index];
+}
+
+long conf_get_argument_count(const conf_directive *dir)
+{
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    return dir->arguments_count;
+}
+
+const conf_comment *conf_get_comment(const conf_unit *unit, long index)
+{
+    if (unit == NULL)
+    {
+        return NULL;
+    }
+    if (index < 0 || index >= unit->comments_count)
+    {
+        return NULL;
+    }
+    return &unit->comments[index];
+}
+
+long conf_get_comment_count(const conf_unit *unit)
+{
+    if (unit == NULL)
+    {
+        return 0;
+    }
+    return unit->comments_count;
+}
+
+// Frees the memory that's only needed while parsing.
+static void free_scratch(conf_unit *unit)
+{
+    if (unit->tokens != NULL)
+    {
+        delete(unit, unit->tokens, sizeof(unit->tokens[0]) * unit->tokens_capacity);
+        unit->tokens = NULL;
+        unit->tokens_capacity = 0;
+    }
+
+    if (unit->argv != NULL)
+    {
+        delete(unit, unit->argv, sizeof(unit->argv[0]) * unit->argv_capacity);
+        unit->argv = NULL;
+        unit->argv_capacity = 0;
+    }
+
+    if (unit->argv_values != NULL)
+    {
+        delete(unit, unit->argv_values, unit->argv_values_capacity);
+        unit->argv_values = NULL;
+        unit->argv_values_capacity = 0;
+    }
+
+    if (unit->pending != NULL)
+    {
+        delete(unit, unit->pending, sizeof(unit->pending[0]) * unit->pending_capacity);
+        unit->pending = NULL;
+        unit->pending_capacity = 0;
+    }
+
+    if (unit->tree_nodes != NULL)
+    {
+        delete(unit, unit->tree_nodes, sizeof(unit->tree_nodes[0]) * unit->tree_nodes_capacity);
+        unit->tree_nodes = NULL;
+        unit->tree_nodes_capacity = 0;
+    }
+
+    if (unit->tree_arguments != NULL)
+    {
+        delete(unit, unit->tree_arguments, sizeof(unit->tree_arguments[0]) * unit->tree_arguments_capacity);
+        unit->tree_arguments = NULL;
+        unit->tree_arguments_capacity = 0;
+    }
+
+    if (unit->tree_values != NULL)
+    {
+        delete(unit, unit->tree_values, sizeof(unit->tree_values[0]) * unit->tree_values_capacity);
+        unit->tree_values = NULL;
+        unit->tree_values_capacity = 0;
+    }
+
+    if (unit->tree_comments != NULL)
+    {
+        delete(unit, unit->tree_comments, sizeof(unit->tree_comments[0]) * unit->tree_comments_capacity);
+        unit->tree_comments = NULL;
+        unit->tree_comments_capacity = 0;
+    }
+}
+
+void deinit_configuration_unit(conf_unit *unit)
+{
+    assert(unit != NULL);
+
+    if (unit->directives != NULL)
+    {
+        delete(unit, unit->directives, sizeof(unit->directives[0]) * unit->directives_count);
+    }
+
+    if (unit->arguments != NULL)
+    {
+        delete(unit, unit->arguments, sizeof(unit->arguments[0]) * unit->arguments_count);
+    }
+
+    if (unit->values != NULL)
+    {
+        delete(unit, unit->values, unit->values_length);
+    }
+
+    if (unit->comments != NULL)
+    {
+        delete(unit, unit->comments, sizeof(unit->comments[0]) * unit->comments_count);
+    }
+
+    // A shared punctuator trie belongs to the syntax in the options.
+    if (unit->syntax.punctuator_trie != NULL && unit->options.syntax == NULL)
+    {
+        delete(unit, unit->syntax.punctuator_trie, unit->syntax.punctuator_trie_size);
+    }
+
+    free_scratch(unit);
+}
+
+void conf_free(conf_unit *unit)
+{
+    if (unit != NULL)
+    {
+        deinit_configuration_unit(unit);
+        delete(unit, unit, sizeof(unit[0]));
+    }
+}
+
+// Converts the parse tree and comments from the scratch arrays they were assembled in to their
+// final form. The final arrays are exactly sized and refer to each other by pointer.
+static void build_tree(conf_unit *unit, const struct tree_node *root)
+{
+    assert(unit != NULL);
+    assert(root != NULL);
+    assert(unit->pending_count == 0);
+
+    if (unit->tree_nodes_count > 0)
+    {
+        unit->directives = new(unit, sizeof(unit->directives[0]) * unit->tree_nodes_count);
+        if (unit->directives == NULL)
+        {
+            die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+        }
+        unit->directives_count = unit->tree_nodes_count;
+
+        unit->arguments = new(unit, sizeof(unit->arguments[0]) * unit->tree_arguments_count);
+        if (unit->arguments == NULL)
+        {
+            die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+        }
+        unit->arguments_count = unit->tree_arguments_count;
+
+        // Every value might be a view in which case there's no value buffer.
+        if (unit->tree_values_length > 0)
+        {
+            unit->values = new(unit, unit->tree_values_length);
+            if (unit->values == NULL)
+            {
+                die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+            }
+            unit->values_length = unit->tree_values_length;
+            memcpy(unit->values, unit->tree_values, unit->values_length);
+        }
+
+        for (size_t i = 0; i < unit->arguments_count; i++)
+        {
+            const struct tree_argument *arg = &unit->tree_arguments[i];
+            unit->arguments[i] = (conf_argument){
+                .value = arg->is_view ? &unit->string[arg->value] : &unit->values[arg->value],
+                .value_length = arg->value_length,
+                .lexeme_offset = arg->lexeme_offset,
+                .lexeme_length = arg->lexeme_length,
+                .is_expression = arg->is_expression,
+            };
+        }
+
+        for (size_t i = 0; i < unit->directives_count; i++)
+        {
+            const struct tree_node *node = &unit->tree_nodes[i];
+            unit->directives[i] = (conf_directive){
+                .subdir = &unit->directives[node->subdir],
+                .arguments = &unit->arguments[node->arguments],
+                .subdir_count = node->subdir_count,
+                .arguments_count = node->arguments_count,
+            };
+        }
+
+        *unit->root = (conf_directive){
+            .subdir = &unit->directives[root->subdir],
+            .subdir_count = root->subdir_count,
+        };
+    }
+
+    if (unit->tree_comments_count > 0)
+    {
+        unit->comments = new(unit, sizeof(unit->comments[0]) * unit->tree_comments_count);
+        if (unit->comments == NULL)
+        {
+            die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+        }
+        memcpy(unit->comments, unit->tree_comments, sizeof(unit->comments[0]) * unit->tree_comments_count);
+        unit->comments_count = (long)unit->tree_comments_count;
+    }
+
+    free_scratch(unit);
+}
+
+static void parse_configuration_unit(conf_unit *unit, struct tree_node *root)
+{
+    // Skip past the a BOM (byte order mark) character if present.
+    if (unit->end - unit->needle >= 3)
+    {
+        if (memcmp(unit->needle, "\xEF\xBB\xBF", 3) == 0)
+        {
+            unit->needle += 3;
+        }
+    }
+
+    // Parse the Confetti configuration unit.
+    parse_body(unit, root, 0);
+
+    // Verify the configuration unit ended by checking for extraneous tokens.
+    token tok;
+    peek(unit, &tok);
+    if (tok.type != TOK_EOF)
+    {
+        assert(tok.type == '}');
+        die(unit, CONF_BAD_SYNTAX, unit->needle, "found '}' without matching '{'");
+    }
 
-    tok->lexeme = string - conf->string;
-    tok->lexeme_length = at - string;
-    tok->type = TOK_COMMENT;
-    tok->flags = 0;
-    tok->trim = 0;
+    // Text given with an explicit length can't contain a null character.
+    if (unit->end < unit->limit)
+    {
+        die(unit, CONF_BAD_SYNTAX, unit->end, "illegal character U+0000");
+    }
 }
 
-static void scan_token(conf_unit *conf, const char *string, token *tok)
+static conf_errno init_punctuator_arguments(struct conf_syntax *syntax, const char **punctuator_arguments, conf_error *err)
 {
-    assert(conf != NULL);
-    assert(string != NULL);
-    assert(tok != NULL);
-
-    if (string[0] == '#')
+    // Count how many punctuator arguments there are and their combined length.
+    long count = 0;
+    size_t total_length = 0;
+    size_t index = 0;
+    for (;;)
     {
-        scan_single_line_comment(conf, string, tok);
-        return;
-    }
+        const char *string = punctuator_arguments[index];
+        if (string == NULL)
+        {
+            break;
+        }
+        index += 1;
 
-    if (conf->extensions.c_style_comments)
-    {
-        // Check for a C style single line comment, e.g. "// this is a commment"
-        if (string[0] == '/' && string[1] == '/')
+        if (string[0] == '\0')
         {
-            scan_single_line_comment(conf, string, tok);
-            return;
+            continue;
         }
+        count += 1;
+        total_length += strlen(string);
 
-        // Check for a C style multi-line comment, e.g. "/* this is a commment */"
-        if (string[0] == '/' && string[1] == '*')
+        // Verify the string only contains valid argument characters; it
+        // cannot contain white space, reserved, or forbidden characters.
+        for (;;)
         {
-            scan_multi_line_comment(conf, string, tok);
-            return;
+            size_t byte_count = 0;
+            const uchar cp = utf8decode2(string, string + strlen(string), &byte_count);
+            if (cp == '\0')
+            {
+                break;
+            }
+            
+            if (cp == BAD_ENCODING)
+            {
+                err->code = CONF_ILLEGAL_BYTE_SEQUENCE;
+                strcpy(err->description, "punctuator argument with malformed UTF-8");
+                return err->code;
+            }
+
+            // If the expression arguments extension is enabled, then disallow parentheses
+            // as they reserved characters with the extension.
+            if (syntax->extensions.expression_arguments)
+            {
+                if (cp == '(' || cp == ')')
+                {
+                    err->code = CONF_INVALID_OPERATION;
+                    strcpy(err->description, "illegal punctuator argument character");
+                    return err->code;
+                }
+            }
+
+            if ((conf_charflags(cp) & IS_ARGUMENT_CHARACTER) == 0)
+            {
+                err->code = CONF_INVALID_OPERATION;
+                strcpy(err->description, "illegal punctuator argument character");
+                return err->code;
+            }
+
+            string += byte_count;
         }
     }
 
-    if (is_newline(conf, string, &tok->lexeme_length))
+    // If the array is empty, then there are no punctuators to add.
+    if (count == 0)
     {
-        tok->type = TOK_NEWLINE;
-        tok->lexeme = string - conf->string;
-        tok->flags = 0;
-        tok->trim = 0;
-        return;
+        return CONF_NO_ERROR;
     }
 
-    const uchar cp = utf8decode(conf, string, NULL);
-    if (conf_uniflags(cp) & IS_SPACE_CHARACTER)
+    // Each byte of each punctuator adds at most one node to the trie. Node zero is reserved.
+    if (total_length >= UINT32_MAX)
     {
-        scan_whitespace(conf, string, tok);
-        return;
+        err->code = CONF_OUT_OF_MEMORY;
+        strcpy(err->description, "memory allocation failed");
+        return err->code;
     }
 
-    if ((conf_uniflags(cp) & IS_BIDI_CHARACTER) && !conf->options.allow_bidi)
+    const size_t size = sizeof(syntax->punctuator_trie[0]) * (total_length + 1);
+    struct trie_node *trie = syntax->allocator(syntax->user_data, NULL, size);
+    if (trie == NULL)
     {
-        die(conf, CONF_BAD_SYNTAX, string, "illegal bidirectional character");
+        err->code = CONF_OUT_OF_MEMORY;
+        strcpy(err->description, "memory allocation failed");
+        return err->code;
     }
+    (void)memset(trie, 0, size);
+    syntax->punctuator_trie = trie;
+    syntax->punctuator_trie_size = size;
 
-    if (conf->punctuators_count > 0)
+    // Insert each punctuator into the trie, adding nodes for bytes that don't have one yet.
+    uint32_t node_count = 1;
+    for (index = 0; punctuator_arguments[index] != NULL; index++)
     {
-        if (scan_punctuator_argument(conf, string, tok, cp))
+        const uint8_t *bytes = (const uint8_t *)punctuator_arguments[index];
+        if (bytes[0] == '\0')
         {
-            return;
+            continue;
+        }
+
+        syntax->punctuator_leads[bytes[0] >> 3] |= (uint8_t)(1 << (bytes[0] & 0x7));
+
+        uint32_t node = 0;
+        for (size_t i = 0; bytes[i] != '\0'; i++)
+        {
+            uint32_t child;
+            if (node == 0)
+            {
+                child = syntax->punctuator_root[bytes[i]];
+            }
+            else
+            {
+                child = trie[node].first_child;
+                while (child != 0 && trie[child].byte != bytes[i])
+                {
+                    child = trie[child].next_sibling;
+                }
+            }
+
+            if (child == 0)
+            {
+                child = node_count++;
+                trie[child].byte = bytes[i];
+                if (node == 0)
+                {
+                    syntax->punctuator_root[bytes[i]] = child;
+                }
+                else
+                {
+                    trie[child].next_sibling = trie[node].first_child;
+                    trie[node].first_child = child;
+                }
+            }
+            node = child;
         }
+        trie[node].terminal = true;
+    }
+
+    return CONF_NO_ERROR;
+}
+
+// Specializes the character flags for the extensions enabled by the configuration unit.
+static void init_character_flags(struct conf_syntax *syntax)
+{
+    memcpy(syntax->ascii_flags, conf_asciiflags, sizeof(syntax->ascii_flags));
+    syntax->extended_flags = 0;
+
+    if (syntax->extensions.expression_arguments)
+    {
+        syntax->ascii_flags['('] |= IS_EXPRESSION_STARTER;
     }
 
-    if (conf->extensions.expression_arguments)
+    for (int byte = 0; byte < 256; byte++)
     {
-        if (string[0] == '(')
+        if ((syntax->punctuator_leads[byte >> 3] & (1 << (byte & 0x7))) == 0)
         {
-            scan_expression_argument(conf, string, tok);
-            return;
+            continue;
+        }
+
+        if (byte < 0x80)
+        {
+            syntax->ascii_flags[byte] |= IS_PUNCTUATOR_STARTER;
+        }
+        else
+        {
+            // Rather than tracking every non-ASCII starter, treat all non-ASCII characters
+            // as potential starters. The punctuator scanner rejects the others by their lead byte.
+            syntax->extended_flags |= IS_PUNCTUATOR_STARTER;
         }
     }
+}
 
-    if ((string[0] == '{') || (string[0] == '}'))
+// Classifies each byte that can begin a token. The order of the checks mirrors the order in which
+// scan_other_token() tries each kind of token, so both always agree. This must be called after
+// the character flags are specialized.
+static void init_token_starts(struct conf_syntax *syntax)
+{
+    for (int byte = 0; byte < 256; byte++)
     {
-        tok->type = (token_type)string[0];
-        tok->lexeme = string - conf->string;
-        tok->lexeme_length = 1;
-        tok->flags = 0;
-        tok->trim = 0;
-        return;
+        token_start start = TOKEN_START_OTHER;
+        const uint8_t flags = (byte < 0x80) ? syntax->ascii_flags[byte] : 0;
+
+        if (byte == '\0')
+        {
+            start = TOKEN_START_END;
+        }
+        else if (byte == '#')
+        {
+            start = TOKEN_START_COMMENT;
+        }
+        else if (byte == '/' && syntax->extensions.c_style_comments)
+        {
+            start = TOKEN_START_SLASH;
+        }
+        else if (byte >= 0x80)
+        {
+            start = TOKEN_START_OTHER; // Multi-byte characters must be decoded.
+        }
+        else if (byte >= 0x0A && byte <= 0x0D)
+        {
+            start = TOKEN_START_NEWLINE; // Line feed, vertical tab, form feed, and carriage return.
+        }
+        else if (flags & IS_SPACE_CHARACTER)
+        {
+            start = TOKEN_START_WHITESPACE;
+        }
+        else if (flags & IS_PUNCTUATOR_STARTER)
+        {
+            start = TOKEN_START_PUNCTUATOR;
+        }
+        else if (flags & IS_EXPRESSION_STARTER)
+        {
+            start = TOKEN_START_EXPRESSION;
+        }
+        else if (byte == '{' || byte == '}')
+        {
+            start = TOKEN_START_BRACE;
+        }
+        else if (byte == '"')
+        {
+            start = TOKEN_START_QUOTE;
+        }
+        else if (byte == ';')
+        {
+            start = TOKEN_START_SEMICOLON;
+        }
+        else if (byte == '\\')
+        {
+            start = TOKEN_START_BACKSLASH;
+        }
+        else if (flags & IS_ARGUMENT_CHARACTER)
+        {
+            start = TOKEN_START_ARGUMENT;
+        }
+        syntax->token_starts[byte] = (uint8_t)start;
     }
-    
-    if (string[0] == '"')
+}
+
+// Determines which ASCII bytes end a run of unquoted argument characters. This must be called
+// after the character flags are specialized because expression and punctuator starters end a run.
+static void init_argument_stops(struct conf_syntax *syntax)
+{
+    struct stopset *set = &syntax->argument_stops;
+    memset(set, 0, sizeof(set[0]));
+
+    // Characters which are not argument characters terminate the argument as do expressions and
+    // punctuators, if their extension is enabled.
+    for (uint8_t byte = 0; byte < 0x80; byte++)
     {
-        if ((string[1] == '"') && (string[2] == '"'))
+        const uint8_t flags = syntax->ascii_flags[byte];
+        if ((flags & IS_ARGUMENT_CHARACTER) == 0 || (flags & (IS_BIDI_CHARACTER | IS_EXPRESSION_STARTER | IS_PUNCTUATOR_STARTER)) != 0)
         {
-            scan_triple_quoted_argument(conf, string, tok);
+            stopset_add(set, byte);
         }
-        else
+    }
+
+    // Escape sequences must be validated by the scanner.
+    stopset_add(set, '\\');
+    stopset_finalize(set);
+}
+
+// Determines which ASCII bytes end a run of comment characters. Control characters must be
+// inspected because they are either line terminators or forbidden characters.
+static void init_comment_stops(struct conf_syntax *syntax)
+{
+    struct stopset *set = &syntax->comment_stops;
+    memset(set, 0, sizeof(set[0]));
+    for (uint8_t byte = 0; byte < 0x80; byte++)
+    {
+        if (byte < 0x20 || byte == 0x7F)
         {
-            scan_single_quoted_argument(conf, string, tok);
+            stopset_add(set, byte);
         }
-        return;
     }
+    stopset_finalize(set);
 
-    if (string[0] == ';')
+    // Multi-line comments must also stop at the asterisk in the closing "*/" sequence.
+    syntax->multi_line_comment_stops = syntax->comment_stops;
+    stopset_add(&syntax->multi_line_comment_stops, '*');
+    stopset_finalize(&syntax->multi_line_comment_stops);
+}
+
+// Determines which ASCII bytes end a run of quoted characters. The run must end at the closing
+// quote, escape sequences, line terminators, and any character forbidden in a quoted argument.
+static void init_quoted_stops(struct conf_syntax *syntax)
+{
+    struct stopset *set = &syntax->quoted_stops;
+    memset(set, 0, sizeof(set[0]));
+    for (uchar cp = 0; cp < 0x80; cp++)
     {
-        tok->type = TOK_SEMICOLON;
-        tok->lexeme = string - conf->string;
-        tok->lexeme_length = 1;
-        tok->flags = 0;
-        tok->trim = 0;
-        return;
+        if ((conf_charflags(cp) & (IS_ESCAPABLE_CHARACTER | IS_SPACE_CHARACTER)) == 0 || (conf_charflags(cp) & IS_BIDI_CHARACTER) != 0)
+        {
+            stopset_add(set, (uint8_t)cp);
+        }
+    }
+    for (uint8_t byte = 0x0A; byte <= 0x0D; byte++)
+    {
+        stopset_add(set, byte);
+    }
+    stopset_add(set, '"');
+    stopset_add(set, '\\');
+    stopset_finalize(set);
+}
+
+// Compiles the syntax described by the options, whose allocator must be set. It's compiled for each
+// configuration unit unless the options refer to a syntax compiled by conf_syntax_compile().
+static conf_errno compile_syntax(struct conf_syntax *syntax, const conf_options *options, conf_error *err)
+{
+    assert(options->allocator != NULL);
+
+    memset(syntax, 0, sizeof(syntax[0]));
+    syntax->allocator = options->allocator;
+    syntax->user_data = options->user_data;
+    if (options->extensions != NULL)
+    {
+        syntax->extensions = *options->extensions;
     }
 
-    if (string[0] == '\\')
+    if (syntax->extensions.punctuator_arguments)
     {
-        size_t length;
-        if (is_newline(conf, &string[1], &length))
+        if (init_punctuator_arguments(syntax, syntax->extensions.punctuator_arguments, err) != CONF_NO_ERROR)
         {
-            tok->type = TOK_CONTINUATION;
-            tok->lexeme = string - conf->string;
-            tok->lexeme_length = length + 1;
-            tok->flags = 0;
-            tok->trim = 0;
-            return;
+            return err->code;
         }
     }
 
-    if (conf_uniflags(cp) & IS_ARGUMENT_CHARACTER)
+    syntax->kernels = select_kernels(options);
+    init_character_flags(syntax);
+    init_token_starts(syntax);
+    init_argument_stops(syntax);
+    init_comment_stops(syntax);
+    init_quoted_stops(syntax);
+    return CONF_NO_ERROR;
+}
+
+// Initializes a Confetti configuration unit structure. This initilaization is common to both the walk() and parse() interfaces.
+static conf_errno init_configuration_unit(conf_unit *unit, const char *string, size_t length, const conf_options *options, conf_error *error, conf_walkfn walk)
+{
+    memset(unit, 0, sizeof(unit[0]));
+    unit->string = string;
+    unit->needle = string;
+    unit->err.where = 0;
+    unit->err.code = CONF_NO_ERROR;
+    unit->walk = walk;
+
+    if (options != NULL)
+    {
+        unit->options = *options;
+    }
+
+    if (unit->options.max_depth < 1)
     {
-        scan_argument(conf, string, tok);
-        return;
+        unit->options.max_depth = 20; // Default maximum nesting depth.
     }
 
-    // For compatibility with source code editing tools that add end-of-file markers, if the last character
-    // of the compilation unit is a Control-Z character (U+001A), this character is deleted.
-    if (string[0] == 0x1A && string[1] == '\0')
+    if (unit->options.allocator == NULL)
     {
-        tok->type = TOK_EOF;
-        tok->lexeme = string - conf->string;
-        tok->lexeme_length = 0;
-        tok->flags = 0;
-        tok->trim = 0;
-        return;
+        unit->options.allocator = &default_alloc;
     }
 
-    if (cp == 0x0)
+    if (string == NULL)
     {
-        tok->type = TOK_EOF;
-        tok->lexeme = string - conf->string;
-        tok->lexeme_length = 0;
-        tok->flags = 0;
-        tok->trim = 0;
-        return;
+        if (error != NULL)
+        {
+            error->code = CONF_INVALID_OPERATION;
+            strcpy(error->description, "missing string argument");
+        }
+        return CONF_INVALID_OPERATION;
     }
-    
-    die(conf, CONF_BAD_SYNTAX, string, "illegal character U+%04X", cp);
+
+    if (unit->options.syntax != NULL)
+    {
+        // The syntax was compiled ahead of time so it's copied, but its punctuator trie is shared.
+        unit->syntax = *unit->options.syntax;
+    }
+    else if (compile_syntax(&unit->syntax, &unit->options, &unit->err) != CONF_NO_ERROR)
+    {
+        if (error != NULL)
+        {
+            memcpy(error, &unit->err, sizeof(unit->err));
+        }
+        return unit->err.code;
+    }
+
+    // Scanning stops at a null character so it's never decoded. If it's followed by more text,
+    // then the parser reports it as illegal once it reaches it.
+    unit->limit = string + length;
+    unit->end = memchr(string, '\0', length);
+    if (unit->end == NULL)
+    {
+        unit->end = unit->limit;
+    }
+    unit->valid_end = unit->syntax.kernels->validate_utf8(string, unit->end);
+    unit->check_bidi = !unit->options.allow_bidi && contains_bidi(string, unit->end);
+    return CONF_NO_ERROR;
 }
 
-static void record_comment(conf_unit *unit, const conf_comment *data)
+conf_syntax *conf_syntax_compile(const conf_options *options, conf_error *error)
 {
-    struct comment *comment = new(unit, sizeof(comment[0]));
-    if (comment == NULL)
+    conf_options opts = {0};
+    if (options != NULL)
+    {
+        opts = *options;
+    }
+
+    if (opts.allocator == NULL)
+    {
+        opts.allocator = &default_alloc;
+    }
+
+    conf_syntax *syntax = opts.allocator(opts.user_data, NULL, sizeof(syntax[0]));
+    if (syntax == NULL)
     {
-        die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+        if (error != NULL)
+        {
+            error->where = 0;
+            error->code = CONF_OUT_OF_MEMORY;
+            strcpy(error->description, "memory allocation failed");
+        }
+        return NULL;
     }
-    comment->data.offset = data->offset;
-    comment->data.length = data->length;
-    comment->next = NULL;
 
-    if (unit->comment_head == NULL)
+    conf_error err = {0};
+    if (compile_syntax(syntax, &opts, &err) != CONF_NO_ERROR)
     {
-        assert(unit->comment_tail == NULL);
-        unit->comment_head = comment;
-        unit->comment_tail = comment;
+        if (error != NULL)
+        {
+            memcpy(error, &err, sizeof(err));
+        }
+        opts.allocator(opts.user_data, syntax, sizeof(syntax[0]));
+        return NULL;
     }
-    else
+
+    if (error != NULL)
     {
-        assert(unit->comment_tail != NULL);
-        unit->comment_tail->next = comment;
-        unit->comment_tail = comment;
+        error->where = 0;
+        error->code = CONF_NO_ERROR;
+        strcpy(error->description, "no error");
     }
-    unit->comments_count += 1;
+    return syntax;
 }
 
-static token_type peek(conf_unit *unit, token *tok)
+void conf_syntax_free(conf_syntax *syntax)
 {
-    assert(unit != NULL);
-    assert(tok != NULL);
-
-    if (unit->peek.type == TOK_INVALID)
+    if (syntax != NULL)
     {
-        for (;;)
+        if (syntax->punctuator_trie != NULL)
         {
-            scan_token(unit, unit->needle, &unit->peek);
-            if (unit->peek.type == TOK_WHITESPACE)
-            {
-                unit->needle += unit->peek.lexeme_length;
-                continue;
-            }
-            else if (unit->peek.type == TOK_COMMENT)
-            {
-                // Prevent the same comment from being reported twice.
-                // Comments might be parsed twice when the parser
-                // is rewound, but they should only be reported
-                // once to the user.
-                if (unit->comment_processed <= unit->peek.lexeme)
-                {
-                    const conf_comment comment = {
-                        .offset = unit->peek.lexeme,
-                        .length = unit->peek.lexeme_length,
-                    };
-                    if (unit->walk == NULL)
-                    {
-                        record_comment(unit, &comment);
-                    }
-                    else if (unit->walk(unit->options.user_data, CONF_COMMENT, 0, NULL, &comment) != 0)
-                    {
-                        die(unit, CONF_USER_ABORTED, unit->needle, "user aborted");
-                    }
-                    unit->comment_processed = comment.offset + comment.length;
-                }
-                unit->needle += unit->peek.lexeme_length;
-                continue;
-            }
-            break;
+            syntax->allocator(syntax->user_data, syntax->punctuator_trie, syntax->punctuator_trie_size);
         }
+        syntax->allocator(syntax->user_data, syntax, sizeof(syntax[0]));
     }
-    *tok = unit->peek;
-    return unit->peek.type;
 }
 
-static token_type eat(conf_unit *conf, token *tok)
+// Represents the contents of a file which is either memory mapped or read into a buffer.
+struct source_file
 {
-    assert(conf != NULL);
-    assert(tok != NULL);
+    const char *data;
+    size_t length;
+    void *mapping; // Start of the memory mapping, or null if the file isn't mapped.
+    char *buffer; // Buffer the file was read into, or null if the file wasn't read.
+    size_t capacity; // Size of the buffer.
+};
 
-    peek(conf, tok);
-    conf->needle += tok->lexeme_length;
-    conf->peek.type = TOK_INVALID;
-    return tok->type;
+static conf_errno file_error(conf_error *error, conf_errno code, const char *description)
+{
+    if (error != NULL)
+    {
+        error->where = 0;
+        error->code = code;
+        strcpy(error->description, description);
+    }
+    return code;
 }
 
-static size_t copy_token_to_buffer(conf_unit *conf, char *dest, const token *tok)
+// Reads a stream into a buffer which is doubled in size whenever it fills up. The buffer is
+// allocated with the user's allocator which doesn't reallocate, so growing it is a copy.
+static conf_errno read_file(FILE *stream, const conf_options *options, struct source_file *file, conf_error *error)
 {
-    assert(conf != NULL);
-    assert(tok != NULL);
-
-    const char *stop_offset = &conf->string[tok->lexeme + tok->lexeme_length];
-    const char *offset = &conf->string[tok->lexeme];
-    size_t nbytes = 0;
-
-    // Discard the N surrounding characters (e.g. quotes in a quoted literal).
-    offset += tok->trim;
-    stop_offset -= tok->trim;
+    const conf_allocfn allocator = (options != NULL && options->allocator != NULL) ? options->allocator : &default_alloc;
+    void *user_data = (options != NULL) ? options->user_data : NULL;
 
-    while (offset < stop_offset)
+    for (;;)
     {
-        if (*offset == '\\')
+        if (file->length == file->capacity)
         {
-            offset += 1; // skip the backslash
+            const size_t capacity = (file->capacity == 0) ? 65536 : file->capacity * 2;
+            if (capacity < file->capacity)
+            {
+                return file_error(error, CONF_OUT_OF_MEMORY, "memory allocation failed");
+            }
 
-            // New lines after a backslash are ignored in single quoted arguments.
-            if (tok->flags & CONF_QUOTED)
+            char *buffer = allocator(user_data, NULL, capacity);
+            if (buffer == NULL)
             {
-                size_t length;
-                if (is_newline(conf, offset, &length))
-                {
-                    offset += length;
-                    continue;
-                }
+                return file_error(error, CONF_OUT_OF_MEMORY, "memory allocation failed");
+            }
+
+            if (file->buffer != NULL)
+            {
+                memcpy(buffer, file->buffer, file->length);
+                allocator(user_data, file->buffer, file->capacity);
             }
+            file->buffer = buffer;
+            file->capacity = capacity;
         }
 
-        size_t length = 0;
-        utf8decode(conf, offset, &length);
-        if (dest != NULL)
+        const size_t count = fread(&file->buffer[file->length], 1, file->capacity - file->length, stream);
+        file->length += count;
+        if (count == 0)
         {
-            memcpy(dest, offset, length);
-            dest += length;
+            if (ferror(stream))
+            {
+                return file_error(error, CONF_IO_ERROR, "failed to read file");
+            }
+            break;
         }
-
-        offset += length;
-        nbytes += length;
     }
 
-    return nbytes;
+    file->data = file->buffer;
+    return CONF_NO_ERROR;
 }
 
-//
-// Parsing directives is a two step process:
-//
-//   (1) arguments are first scanned and counted, additionally the total number
-//       of characters to represent the arguments is also counted
-//
-//   (2) arrays large enough to accommodate the arguments and characters is reserved
-//       and arguments are re-scanned and their data is copied to these buffer
-//
-// The point of step #1 is to reduce the number of overall allocations and to avoid the
-// use of dynamic array (scanning a quoted literal is cheaper than allocating memory).
-//
-
-static void parse_directive(conf_unit *conf, conf_directive *parent, int depth)
+// Loads a file for parsing. Regular files are memory mapped, with sequential access advice,
+// so they're parsed directly from the page cache. Everything else, like pipes, is read into
+// a buffer as is any file that can't be mapped.
+static conf_errno load_file(const char *path, const conf_options *options, struct source_file *file, conf_error *error)
 {
-    assert(conf != NULL);
-    assert(depth >= 0);
-
-    token tok;
-
-    // (1) figure out how much memory is needed for the arguments
+    memset(file, 0, sizeof(file[0]));
+    file->data = "";
 
-    const token saved_peek = conf->peek; // save parser unit
-    const char *saved_needle = conf->needle;
-
-    long argument_count = 0;
-    long buffer_length = 0;
-    for (;;)
+    if (path == NULL)
     {
-        peek(conf, &tok);
-        if (tok.type == TOK_ARGUMENT)
-        {
-            argument_count += 1;
-            buffer_length += copy_token_to_buffer(conf, NULL, &tok) + 1; // +1 for null byte
-            eat(conf, &tok);
-        }
-        else if (tok.type == TOK_CONTINUATION)
-        {
-            eat(conf, &tok);
-        }
-        else
-        {
-            break;
-        }
+        return file_error(error, CONF_INVALID_OPERATION, "missing path argument");
     }
-    conf->peek = saved_peek; // rewind parser unit
-    conf->needle = saved_needle;
-
-    // (2) allocate storage for the arguments and copy the data to it
 
-    const size_t size = sizeof(conf_directive) + (size_t)buffer_length;
-    conf_directive *dir = zero_new(conf, size);
-    if (dir == NULL)
+#if defined(HAVE_MMAP)
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
     {
-        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+        return file_error(error, CONF_IO_ERROR, "failed to open file");
     }
-    dir->buffer_length = buffer_length;
 
-    const long argc = argument_count;
-    conf_argument *argv = new(conf, sizeof(argv[0]) * argc);
-    if (argv == NULL)
+    struct stat info;
+    if (fstat(fd, &info) != 0)
     {
-        delete(conf, dir, size);
-        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+        close(fd);
+        return file_error(error, CONF_IO_ERROR, "failed to read file");
     }
-    dir->arguments = argv;
-    dir->arguments_count = argc;
 
-    char *buffer = dir->buffer;
-    argument_count = 0;
-    for (;;)
+    if (S_ISREG(info.st_mode))
     {
-        peek(conf, &tok);
-        if (tok.type == TOK_ARGUMENT)
+        if ((uintmax_t)info.st_size > SIZE_MAX)
         {
-            conf_argument *arg = &argv[argument_count++];
-            arg->lexeme_offset = tok.lexeme;
-            arg->lexeme_length = tok.lexeme_length;
-            arg->value = buffer;
-            arg->is_expression = (tok.flags & CONF_EXPRESSION) ? true : false;
-            buffer += copy_token_to_buffer(conf, buffer, &tok) + 1; // +1 for null byte
-            eat(conf, &tok);
+            close(fd);
+            return file_error(error, CONF_IO_ERROR, "file too large");
         }
-        else if (tok.type == TOK_CONTINUATION)
+
+        // Empty files can't be mapped, but there's nothing to read from them either.
+        if (info.st_size == 0)
         {
-            eat(conf, &tok);
+            close(fd);
+            return CONF_NO_ERROR;
         }
-        else
+
+        void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
         {
-            break;
+            (void)posix_madvise(mapping, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+            close(fd);
+            file->mapping = mapping;
+            file->data = mapping;
+            file->length = (size_t)info.st_size;
+            return CONF_NO_ERROR;
         }
     }
 
-    // Link this directive with its parent directive.
-    if (parent->subdir_head == NULL)
-    {
-        assert(parent->subdir_tail == NULL);
-        parent->subdir_head = dir;
-        parent->subdir_tail = dir;
-    }
-    else
+    FILE *stream = fdopen(fd, "rb");
+    if (stream == NULL)
     {
-        assert(parent->subdir_tail != NULL);
-        parent->subdir_tail->next = dir;
-        parent->subdir_tail = dir;
+        close(fd);
+        return file_error(error, CONF_IO_ERROR, "failed to read file");
     }
-    
-    // Check for an optional, terminating semicolon.
-    if (tok.type == ';')
+#else
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
     {
-        eat(conf, &tok); // consume ';'
-        return;
+        return file_error(error, CONF_IO_ERROR, "failed to open file");
     }
+#endif
 
-    // Consume as many new lines as possible.
-    while (tok.type == TOK_NEWLINE)
+    const conf_errno eno = read_file(stream, options, file, error);
+    fclose(stream);
+    return eno;
+}
+
+static void unload_file(const conf_options *options, struct source_file *file)
+{
+#if defined(HAVE_MMAP)
+    if (file->mapping != NULL)
     {
-        eat(conf, &tok);
-        peek(conf, &tok);
+        munmap(file->mapping, file->length);
     }
+#endif
 
-    // Check for an optional subdirective.
-    if (tok.type == '{')
+    if (file->buffer != NULL)
     {
-        eat(conf, &tok); // consume '{'
-        parse_body(conf, dir, depth + 1);
-
-        peek(conf, &tok);
-        if (tok.type == '}')
-        {
-            eat(conf, &tok); // consume '}'
-            peek(conf, &tok);
-        }
-        else
-        {
-            die(conf, CONF_BAD_SYNTAX, conf->needle, "expected '}'");
-        }
-
-        // Check for an optional, terminating semicolon.
-        if (tok.type == ';')
-        {
-            eat(conf, &tok); // consume ';'
-        }
+        const conf_allocfn allocator = (options != NULL && options->allocator != NULL) ? options->allocator : &default_alloc;
+        allocator((options != NULL) ? options->user_data : NULL, file->buffer, file->capacity);
     }
 }
 
-static void walk_directive(conf_unit *conf, int depth)
+conf_unit *conf_parse_file(const char *path, const conf_options *options, conf_error *error)
 {
-    assert(conf != NULL);
-    assert(depth >= 0);
-
-    token tok;
+    struct source_file file;
+    if (load_file(path, options, &file, error) != CONF_NO_ERROR)
+    {
+        unload_file(options, &file);
+        return NULL;
+    }
 
-    // (1) figure out how much memory is needed for the arguments
+    // The file is unloaded once it's parsed so values can't be viewed in it.
+    conf_options parse_options = {0};
+    if (options != NULL)
+    {
+        parse_options = *options;
+    }
+    parse_options.argument_views = false;
 
-    const token saved_peek = conf->peek; // save parser state
-    const char *saved_needle = conf->needle;
+    conf_unit *unit = conf_parse_n(file.data, file.length, &parse_options, error);
+    unload_file(options, &file);
+    return unit;
+}
 
-    int args_count = 0;
-    int buffer_length = 0;
-    for (;;)
+conf_errno conf_walk_file(const char *path, const conf_options *options, conf_error *error, conf_walkfn walk)
+{
+    // Check for the callback function before reading the file.
+    if (walk == NULL)
     {
-        peek(conf, &tok);
-        if (tok.type == TOK_ARGUMENT)
-        {
-            args_count += 1;
-            buffer_length += copy_token_to_buffer(conf, NULL, &tok) + 1; // +1 for null byte
-            eat(conf, &tok);
-        }
-        else if (tok.type == TOK_CONTINUATION)
-        {
-            eat(conf, &tok);
-        }
-        else
-        {
-            break;
-        }
+        return file_error(error, CONF_INVALID_OPERATION, "missing function argument");
     }
-    conf->peek = saved_peek; // rewind parser state
-    conf->needle = saved_needle;
 
-    // (2) allocate storage for the arguments and copy the data to it
-
-    char *args_buffer = zero_new(conf, buffer_length);
-    if (args_buffer == NULL)
+    struct source_file file;
+    const conf_errno eno = load_file(path, options, &file, error);
+    if (eno != CONF_NO_ERROR)
     {
-        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+        unload_file(options, &file);
+        return eno;
     }
 
-    const int argc = args_count;
-    struct conf_argument *argv = new(conf, argc * sizeof(argv[0]));
-    if (argv == NULL)
+    const conf_errno result = conf_walk_n(file.data, file.length, options, error, walk);
+    unload_file(options, &file);
+    return result;
+}
+
+// Parses the source text into a configuration unit. If 'insitu' is non-null, then it's a writable
+// alias of 'string' in which argument values are unescaped.
+static conf_unit *parse_string(const char *string, size_t length, char *insitu, const conf_options *options, conf_error *error)
+{
+    conf_unit *unit = NULL, tmp;
+    const conf_errno eno = init_configuration_unit(&tmp, string, length, options, error, NULL);
+    if (eno != CONF_NO_ERROR)
     {
-        delete(conf, args_buffer, buffer_length);
-        die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+        deinit_configuration_unit(&tmp);
+        return NULL;
     }
+    tmp.insitu = insitu;
 
-    char *buffer = args_buffer;
-    args_count = 0;
-    for (;;)
+    // Allocate the top-level directive and then begin parsing.
+    unit = new(&tmp, sizeof(tmp));
+    if (unit == NULL)
     {
-        peek(conf, &tok);
-        if (tok.type == TOK_ARGUMENT)
-        {
-            conf_argument *arg = &argv[args_count++];
-            arg->lexeme_offset = tok.lexeme;
-            arg->lexeme_length = tok.lexeme_length;
-            arg->value = buffer;
-            arg->is_expression = (tok.flags & CONF_EXPRESSION) ? true : false;
-            buffer += copy_token_to_buffer(conf, buffer, &tok) + 1; // +1 for null byte
-            eat(conf, &tok);
-        }
-        else if (tok.type == TOK_CONTINUATION)
-        {
-            eat(conf, &tok);
-        }
-        else
+        if (error != NULL)
         {
-            break;
+            error->code = CONF_OUT_OF_MEMORY;
+            strcpy(error->description, "memory allocation failed");
         }
+        deinit_configuration_unit(&tmp);
+        return NULL;
     }
+    memcpy(unit, &tmp, sizeof(unit[0]));
+    unit->root = (conf_directive *)unit->padding;
 
-    int r = conf->walk(conf->options.user_data, CONF_DIRECTIVE, argc, argv, NULL);
-    delete(conf, argv, argc * sizeof(argv[0]));
-    delete(conf, args_buffer, buffer_length);
-    if (r != 0)
+    // Setup exception-like handling for unrecoverable errors.
+    if (setjmp(unit->err_buf) != 0)
     {
-        die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+        if (error != NULL)
+        {
+            memcpy(error, &unit->err, sizeof(error[0]));
+        }
+        conf_free(unit);
+        return NULL;
     }
+    struct tree_node root = {0};
+    parse_configuration_unit(unit, &root);
+    build_tree(unit, &root);
 
-    // Check for an optional, terminating semicolon.
-    if (tok.type == ';')
+    if (error != NULL)
     {
-        eat(conf, &tok); // consume ';'
-        return;
+        error->where = unit->needle - unit->string;
+        error->code = CONF_NO_ERROR;
+        strcpy(error->description, "no error");
     }
+    return unit;
+}
 
-    // Consume as many new lines as possible.
-    while (tok.type == TOK_NEWLINE)
-    {
-        eat(conf, &tok);
-        peek(conf, &tok);
-    }
+conf_unit *conf_parse(const char *string, const conf_options *options, conf_error *error)
+{
+    return conf_parse_n(string, (string != NULL) ? strlen(string) : 0, options, error);
+}
+
+conf_unit *conf_parse_n(const char *string, size_t length, const conf_options *options, conf_error *error)
+{
+    return parse_string(string, length, NULL, options, error);
+}
+
+conf_unit *conf_parse_insitu(char *string, const conf_options *options, conf_error *error)
+{
+    return parse_string(string, (string != NULL) ? strlen(string) : 0, string, options, error);
+}
 
-    // Check for an optional subdirective.
-    if (tok.type == '{')
-    {
-        eat(conf, &tok); // consume '{'
+// Prepares a unit to be built in the 'capacity' bytes of storage at 'storage'. When the storage is
+// null the unit is only measured: it's parsed as if it were being built, but nothing is written.
+static void init_storage(conf_unit *unit, unsigned char *storage, size_t capacity)
+{
+    unit->use_storage = true;
+    unit->measuring = (storage == NULL);
+    unit->storage = storage;
+    unit->storage_capacity = capacity;
+    unit->storage_comments = SIZE_MAX;
+}
 
-        r = conf->walk(conf->options.user_data, CONF_BLOCK_ENTER, 0, NULL, NULL);
-        if (r != 0)
+// Builds the configuration unit in its storage. The root directive and the comments are stored
+// last. A punctuator trie that belongs to the unit is moved to the storage first so the unit
+// doesn't hold on to any heap memory.
+static void parse_into_storage(conf_unit *unit)
+{
+    if (unit->syntax.punctuator_trie != NULL && unit->options.syntax == NULL)
+    {
+        const size_t offset = storage_new(unit, unit->syntax.punctuator_trie_size);
+        if (!unit->measuring)
         {
-            die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+            struct trie_node *trie = (struct trie_node *)(unit->storage + offset);
+            memcpy(trie, unit->syntax.punctuator_trie, unit->syntax.punctuator_trie_size);
+            unit->syntax.allocator(unit->syntax.user_data, unit->syntax.punctuator_trie, unit->syntax.punctuator_trie_size);
+            unit->syntax.punctuator_trie = trie;
         }
+    }
 
-        parse_body(conf, NULL, depth + 1);
+    struct tree_node root = {0};
+    parse_configuration_unit(unit, &root);
 
-        peek(conf, &tok);
-        if (tok.type == '}')
-        {
-            eat(conf, &tok); // consume '}'
-            peek(conf, &tok);
+    const size_t offset = storage_new(unit, sizeof(unit->comments[0]) * unit->tree_comments_count);
+    if (!unit->measuring)
+    {
+        *unit->root = (conf_directive){
+            .subdir = (const conf_directive *)(unit->storage + root.subdir),
+            .subdir_count = root.subdir_count,
+        };
 
-            r = conf->walk(conf->options.user_data, CONF_BLOCK_LEAVE, 0, NULL, NULL);
-            if (r != 0)
+        // The comment records are linked in reverse so the array is filled from its end.
+        if (unit->tree_comments_count > 0)
+        {
+            unit->comments = (conf_comment *)(unit->storage + offset);
+            unit->comments_count = (long)unit->tree_comments_count;
+            size_t record = unit->storage_comments;
+            for (size_t i = unit->tree_comments_count; i > 0; i--)
             {
-                die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
+                const struct comment_record *r = (const struct comment_record *)(unit->storage + record);
+                unit->comments[i - 1] = r->comment;
+                record = r->previous;
             }
         }
-        else
-        {
-            die(conf, CONF_BAD_SYNTAX, conf->needle, "expected '}'");
-        }
-
-        // Check for a terminating semicolon.
-        if (tok.type == ';')
-        {
-            eat(conf, &tok); // consume ';'
-        }
     }
 }
 
-// Directive lists are parsed in a single pass and collected into a linked list.
-// After parsing is complete and the linked list is fully constructed, then the
-// list items are copied to an array for O(1) access.
-static void parse_body(conf_unit *conf, conf_directive *parent, int depth)
+size_t conf_measure(const char *string, size_t length, const conf_options *options, conf_error *error)
 {
-    assert(conf != NULL);
-    assert(depth >= 0);
-
-    // Check if the maxmimum nesting depth has been exceeded.
-    if (depth >= conf->options.max_depth)
+    conf_unit unit;
+    if (init_configuration_unit(&unit, string, length, options, error, NULL) != CONF_NO_ERROR)
     {
-        die(conf, CONF_MAX_DEPTH_EXCEEDED, conf->needle, "maximum nesting depth exceeded");
+        deinit_configuration_unit(&unit);
+        return 0;
     }
 
-    // Parse all subdirectives into a linked list.
-    long subdirs_count = 0;
-    for (;;)
+    // The storage is unlimited, except that rounding the size of the unit and its peak usage
+    // up to the maximum alignment mustn't overflow.
+    const size_t unit_size = round_to_alignment(sizeof(unit));
+    init_storage(&unit, NULL, (SIZE_MAX - unit_size) & ~(size_t)(MAX_ALIGNMENT - 1));
+
+    size_t size = 0;
+    if (setjmp(unit.err_buf) == 0)
     {
-        token tok;
-        if (peek(conf, &tok) == TOK_EOF)
+        parse_into_storage(&unit);
+        size = unit_size + round_to_alignment(unit.storage_peak);
+        if (error != NULL)
         {
-            break;
+            error->where = unit.needle - unit.string;
+            error->code = CONF_NO_ERROR;
+            strcpy(error->description, "no error");
         }
+    }
+    else if (error != NULL)
+    {
+        memcpy(error, &unit.err, sizeof(error[0]));
+    }
 
-        if (tok.type == TOK_ARGUMENT)
-        {
-            if (parent == NULL)
-            {
-                walk_directive(conf, depth);
-                assert(conf->walk != NULL);
-            }
-            else
-            {
-                parse_directive(conf, parent, depth);
-                subdirs_count += 1;
-                assert(conf->walk == NULL);
-            }
-            continue;
-        }
+    // Nothing was stored, so a punctuator trie compiled for the unit is still on the heap.
+    unit.use_storage = false;
+    deinit_configuration_unit(&unit);
+    return size;
+}
 
-        if (tok.type == TOK_NEWLINE)
+conf_unit *conf_parse_into(void *buffer, size_t size, const char *string, size_t length, const conf_options *options, conf_error *error)
+{
+    if (buffer == NULL || ((uintptr_t)buffer & (MAX_ALIGNMENT - 1)) != 0)
+    {
+        if (error != NULL)
         {
-            eat(conf, &tok);
-            continue;
+            error->where = 0;
+            error->code = CONF_INVALID_OPERATION;
+            strcpy(error->description, "missing or misaligned buffer argument");
         }
+        return NULL;
+    }
 
-        // Check for a subdirective terminator.
-        // This will be handled by the caller.
-        if (tok.type == '}')
-        {
-            break;
-        }
+    conf_unit tmp;
+    if (init_configuration_unit(&tmp, string, length, options, error, NULL) != CONF_NO_ERROR)
+    {
+        deinit_configuration_unit(&tmp);
+        return NULL;
+    }
 
-        if (tok.type == TOK_CONTINUATION)
+    if (size < round_to_alignment(sizeof(tmp)))
+    {
+        if (error != NULL)
         {
-            die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected line continuation");
+            error->where = 0;
+            error->code = CONF_OUT_OF_MEMORY;
+            strcpy(error->description, "buffer too small");
         }
-
-        assert((tok.type == ';') || (tok.type == '{'));
-        die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected '%c'", tok.type);
+        deinit_configuration_unit(&tmp);
+        return NULL;
     }
 
-    if (subdirs_count > 0)
+    // The unit is placed at the beginning of the buffer and the tree is built in the rest of it.
+    conf_unit *unit = buffer;
+    memcpy(unit, &tmp, sizeof(unit[0]));
+    unit->root = (conf_directive *)unit->padding;
+    const size_t unit_size = round_to_alignment(sizeof(unit[0]));
+    init_storage(unit, (unsigned char *)buffer + unit_size, (size - unit_size) & ~(size_t)(MAX_ALIGNMENT - 1));
+
+    // Setup exception-like handling for unrecoverable errors.
+    if (setjmp(unit->err_buf) != 0)
     {
-        // Allocate an array large enough to accomidate the subdirectives for O(1) access.
-        conf_directive **subdirs = new(conf, sizeof(subdirs[0]) * subdirs_count);
-        if (subdirs == NULL)
+        if (error != NULL)
         {
-            die(conf, CONF_OUT_OF_MEMORY, conf->needle, "memory allocation failed");
+            memcpy(error, &unit->err, sizeof(error[0]));
         }
-        
-        // Copy subdirective pointers to the array.
-        long index = 0;
-        for (conf_directive *curr = parent->subdir_head; curr != NULL; curr = curr->next)
+
+        // If the buffer was too small for the punctuator trie, then it's still on the heap.
+        if (unit->syntax.punctuator_trie != NULL && unit->options.syntax == NULL && unit->storage_low == 0)
         {
-            subdirs[index] = curr;
-            index += 1;
+            unit->syntax.allocator(unit->syntax.user_data, unit->syntax.punctuator_trie, unit->syntax.punctuator_trie_size);
         }
-        parent->subdir = subdirs;
-        parent->subdir_count = subdirs_count;
-    }
-}
-
-const conf_directive *conf_get_directive(const conf_directive *dir, long index)
-{
-    if (dir == NULL)
-    {
         return NULL;
     }
-    if (index < 0 || index >= dir->subdir_count)
+    parse_into_storage(unit);
+
+    if (error != NULL)
     {
-        return NULL;
+        error->where = unit->needle - unit->string;
+        error->code = CONF_NO_ERROR;
+        strcpy(error->description, "no error");
     }
-    return dir->subdir[index];
+    return unit;
 }
 
-long conf_get_directive_count(const conf_directive *dir)
+conf_errno conf_walk(const char *string, const conf_options *options, conf_error *error, conf_walkfn walk)
 {
-    if (dir == NULL)
-    {
-        return 0;
-    }
-    return dir->subdir_count;
+    return conf_walk_n(string, (string != NULL) ? strlen(string) : 0, options, error, walk);
 }
 
-const conf_directive *conf_get_root(const conf_unit *unit)
+conf_errno conf_walk_n(const char *string, size_t length, const conf_options *options, conf_error *error, conf_walkfn walk)
 {
-    if (unit == NULL)
+    // The configuration unit walker interface requires a callback function to invoke
+    // when an "interesting" configuration unit element is found, e.g. a directive.
+    if (walk == NULL)
     {
-        return NULL;
+        if (error != NULL)
+        {
+            error->code = CONF_INVALID_OPERATION;
+            strcpy(error->description, "missing function argument");
+        }
+        return CONF_INVALID_OPERATION;
     }
-    return unit->root;
-}
 
-const conf_argument *conf_get_argument(const conf_directive *dir, long index)
-{
-    if (dir == NULL)
+    conf_unit unit;
+    const conf_errno eno = init_configuration_unit(&unit, string, length, options, error, walk);
+    if (eno != CONF_NO_ERROR)
     {
-        return NULL;
+        deinit_configuration_unit(&unit);
+        return eno;
     }
-    if (index < 0 || index >= dir->arguments_count)
+
+    // Setup exception-like handling for unrecoverable errors.
+    if (setjmp(unit.err_buf) == 0)
     {
-        return NULL;
+        parse_configuration_unit(&unit, NULL);
+        if (error != NULL)
+        {
+            error->where = unit.needle - unit.string;
+            error->code = CONF_NO_ERROR;
+            strcpy(error->description, "no error");
+        }
     }
-    return &dir->arguments[index];
+    else if (error != NULL)
+    {
+        memcpy(error, &unit.err, sizeof(error[0]));
+    }
+
+    deinit_configuration_unit(&unit);
+    return unit.err.code;
 }
 
-long conf_get_argument_count(const conf_directive *dir)
+//
+// Streams walk a configuration unit that's received in chunks. Readers also use them to walk a
+// configuration unit one element at a time. The recursive descent parser
+// can't be paused midway through the source text, so streams parse with a state machine that
+// follows the same grammar instead. Its state is saved after every token it consumes: if a
+// scanner reaches the end of the input received so far, then scanning is abandoned and resumed
+// from the beginning of the token once more input arrives. Only the partial token, or the
+// arguments of the directive being scanned, are buffered between chunks.
+//
+
+enum stream_state
 {
-    if (dir == NULL)
+    STREAM_BODY, // Expecting a directive, the end of a block, or the end of the text.
+    STREAM_ARGUMENTS, // Scanning the arguments of a directive into the token buffer.
+    STREAM_AFTER_ARGUMENTS, // Expecting a semicolon, new lines, or a block.
+    STREAM_AFTER_NEW_LINES, // Expecting more new lines or a block.
+    STREAM_AFTER_BLOCK, // Expecting the optional semicolon that follows a block.
+    STREAM_END,
+};
+
+struct conf_stream
+{
+    conf_unit unit;
+
+    // Source text which has been received, but not yet consumed, by the parser.
+    char *buffer;
+    size_t length;
+    size_t capacity;
+
+    // Parsing is retried once this many bytes are buffered. When a scanner is suspended the
+    // text it scanned is scanned again so waiting for the buffer to grow in proportion to it
+    // keeps a token that spans many chunks from being scanned many times over.
+    size_t retry_length;
+
+    size_t arguments_length; // Number of bytes needed to store the values of the buffered arguments.
+    int depth; // Nesting depth of the block being parsed.
+    enum stream_state state;
+    bool started; // True if the beginning of the text, which might be a BOM, has been parsed.
+    bool finished;
+
+    // Readers have no walk callback; the element found by the last step is saved here instead.
+    conf_element element;
+    int argc;
+    bool has_element;
+};
+
+struct conf_reader
+{
+    conf_stream stream;
+    size_t next_comment; // Index of the next comment to read from the comments found by the last step.
+};
+
+// Appends a chunk of source text to the buffer. If the chunk contains a null character, then
+// the source text ends there and the parser reports it as illegal once it reaches it.
+static void stream_append(conf_stream *stream, const char *chunk, size_t length)
+{
+    conf_unit *conf = &stream->unit;
+    const char *null = memchr(chunk, '\0', length);
+    if (null != NULL)
     {
-        return 0;
+        length = (size_t)(null - chunk) + 1;
     }
-    return dir->arguments_count;
+    else if (length == 0)
+    {
+        return;
+    }
+
+    const size_t needle = (size_t)(conf->needle - conf->string);
+    const size_t valid_end = (size_t)(conf->valid_end - conf->string);
+    stream->buffer = grow_array(conf, stream->buffer, &stream->capacity, stream->length, length, sizeof(stream->buffer[0]));
+    memcpy(&stream->buffer[stream->length], chunk, length);
+    stream->length += length;
+
+    conf->string = stream->buffer;
+    conf->needle = &stream->buffer[needle];
+    conf->limit = &stream->buffer[stream->length];
+    conf->end = (null != NULL) ? conf->limit - 1 : conf->limit;
+    conf->streaming = (null == NULL);
+
+    // Validation resumes from the first malformed sequence, which might only be incomplete.
+    conf->valid_end = conf->syntax.kernels->validate_utf8(&stream->buffer[valid_end], conf->end);
 }
 
-const conf_comment *conf_get_comment(const conf_unit *unit, long index)
+// Discards the source text that's been consumed and will not be scanned again.
+static void stream_discard(conf_stream *stream)
 {
-    if (unit == NULL)
+    conf_unit *conf = &stream->unit;
+    size_t discard = (size_t)(conf->needle - conf->string);
+    if (stream->state == STREAM_ARGUMENTS && conf->tokens_count > 0)
     {
-        return NULL;
+        discard = conf->tokens[0].lexeme;
     }
-    if (index < 0 || index >= unit->comments_count)
+
+    if (discard == 0)
     {
-        return NULL;
+        return;
     }
-    return &unit->comments[index]->data;
-}
 
-long conf_get_comment_count(const conf_unit *unit)
-{
-    if (unit == NULL)
+    memmove(stream->buffer, &stream->buffer[discard], stream->length - discard);
+    stream->length -= discard;
+    for (size_t i = 0; i < conf->tokens_count; i++)
     {
-        return 0;
+        conf->tokens[i].lexeme -= discard;
     }
-    return unit->comments_count;
+
+    conf->base += discard;
+    conf->needle -= discard;
+    conf->end -= discard;
+    conf->limit -= discard;
+    conf->valid_end -= discard;
 }
 
-static void free_directive(conf_unit *conf, conf_directive *dir)
+// Reports an element to the walk callback or, for a reader, saves it until it's read.
+static void stream_report_element(conf_stream *stream, conf_element element)
 {
-    conf_directive *subdir = dir->subdir_head;
-    while (subdir != NULL)
+    conf_unit *conf = &stream->unit;
+    if (conf->walk == NULL)
     {
-        conf_directive *next = subdir->next;
-        free_directive(conf, subdir);
-        subdir = next;
+        assert(!stream->has_element);
+        stream->element = element;
+        stream->has_element = true;
     }
-    
-    if (dir->subdir_count > 0)
+    else if (conf->walk(conf->options.user_data, element, 0, NULL, NULL) != 0)
     {
-        delete(conf, dir->subdir, sizeof(dir->subdir[0]) * dir->subdir_count);
+        die(conf, CONF_USER_ABORTED, conf->needle, "user aborted");
     }
-    
-    assert(dir->arguments_count > 0);
-    delete(conf, dir->arguments, sizeof(dir->arguments[0]) * dir->arguments_count);
-    delete(conf, dir, sizeof(dir[0]) + dir->buffer_length);
 }
 
-void deinit_configuration_unit(conf_unit *unit)
+// Consumes one token, or reports one element, and advances the state machine.
+static void stream_step(conf_stream *stream)
 {
-    assert(unit != NULL);
+    conf_unit *conf = &stream->unit;
+    token tok;
 
-    if (unit->root != NULL)
+    switch (stream->state)
     {
-        conf_directive *root = unit->root;
-        conf_directive *dir = root->subdir_head;
-        while (dir != NULL)
+    case STREAM_BODY:
+        switch (peek(conf, &tok))
+        {
+        case TOK_EOF:
+            if (stream->depth > 0)
+            {
+                die(conf, CONF_BAD_SYNTAX, conf->needle, "expected '}'");
+            }
+
+            // Text given with an explicit length can't contain a null character.
+            if (conf->end < conf->limit)
+            {
+                die(conf, CONF_BAD_SYNTAX, conf->end, "illegal character U+0000");
+            }
+            stream->state = STREAM_END;
+            return;
+
+        case TOK_ARGUMENT:
+            conf->tokens_count = 0;
+            stream->arguments_length = 0;
+            stream->state = STREAM_ARGUMENTS;
+            return;
+
+        case TOK_NEWLINE:
+            eat(conf, &tok);
+            return;
+
+        case '}':
+            if (stream->depth == 0)
+            {
+                die(conf, CONF_BAD_SYNTAX, conf->needle, "found '}' without matching '{'");
+            }
+            eat(conf, &tok); // consume '}'
+            stream->depth -= 1;
+            stream->state = STREAM_AFTER_BLOCK;
+            return;
+
+        case TOK_CONTINUATION:
+            die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected line continuation");
+
+        default:
+            assert((tok.type == ';') || (tok.type == '{'));
+            die(conf, CONF_BAD_SYNTAX, conf->needle, "unexpected '%c'", tok.type);
+        }
+
+    case STREAM_ARGUMENTS:
+        peek(conf, &tok);
+        if (tok.type == TOK_ARGUMENT)
+        {
+            stream->arguments_length += push_token(conf, &tok);
+            eat(conf, &tok);
+        }
+        else if (tok.type == TOK_CONTINUATION)
+        {
+            eat(conf, &tok);
+        }
+        else if (conf->walk == NULL)
+        {
+            buffer_arguments(conf, stream->arguments_length);
+            stream->argc = (int)conf->tokens_count;
+            stream_report_element(stream, CONF_DIRECTIVE);
+            conf->tokens_count = 0;
+            stream->state = STREAM_AFTER_ARGUMENTS;
+        }
+        else
+        {
+            walk_arguments(conf, stream->arguments_length);
+            conf->tokens_count = 0;
+            stream->state = STREAM_AFTER_ARGUMENTS;
+        }
+        return;
+
+    case STREAM_AFTER_ARGUMENTS:
+    case STREAM_AFTER_NEW_LINES:
+        peek(conf, &tok);
+        if (tok.type == ';' && stream->state == STREAM_AFTER_ARGUMENTS)
         {
-            conf_directive *next = dir->next;
-            free_directive(unit, dir);
-            dir = next;
+            eat(conf, &tok); // consume ';'
+            stream->state = STREAM_BODY;
         }
-
-        if (root->subdir_count > 0)
+        else if (tok.type == TOK_NEWLINE)
         {
-            delete(unit, root->subdir, sizeof(root->subdir[0]) * root->subdir_count);
+            eat(conf, &tok);
+            stream->state = STREAM_AFTER_NEW_LINES;
         }
-    }
+        else if (tok.type == '{')
+        {
+            eat(conf, &tok); // consume '{'
+            stream_report_element(stream, CONF_BLOCK_ENTER);
 
-    if (unit->comments_count > 0)
-    {
-        struct comment *comment = unit->comment_head;
-        while (comment != NULL)
+            // Check if the maxmimum nesting depth has been exceeded.
+            if (stream->depth + 1 >= conf->options.max_depth)
+            {
+                die(conf, CONF_MAX_DEPTH_EXCEEDED, conf->needle, "maximum nesting depth exceeded");
+            }
+            stream->depth += 1;
+            stream->state = STREAM_BODY;
+        }
+        else
         {
-            struct comment *next = comment->next;
-            delete(unit, comment, sizeof(comment[0]));
-            comment = next;
+            stream->state = STREAM_BODY;
         }
+        return;
 
-        if (unit->comments != NULL)
+    case STREAM_AFTER_BLOCK:
+        peek(conf, &tok);
+        stream_report_element(stream, CONF_BLOCK_LEAVE);
+
+        // Check for a terminating semicolon.
+        if (tok.type == ';')
         {
-            delete(unit, unit->comments, sizeof(unit->comments[0]) * unit->comments_count);
+            eat(conf, &tok); // consume ';'
         }
-    }
+        stream->state = STREAM_BODY;
+        return;
 
-    if (unit->punctuator_starters != NULL)
-    {
-        delete(unit, unit->punctuator_starters, unit->punctuator_starters_size);
+    case STREAM_END:
+        break;
     }
+}
 
-    if (unit->punctuators != NULL)
+// Skips past the a BOM (byte order mark) character if present.
+static void stream_start(conf_stream *stream)
+{
+    conf_unit *conf = &stream->unit;
+    if (!stream->started)
     {
-        for (long i = 0; i < unit->punctuators_count; i++)
+        if (conf->end - conf->needle < 3 && conf->streaming)
         {
-            struct punctset *punct = unit->punctuators[i];
-            if (punct != NULL)
-            {
-                delete(unit, punct, punct->size);
-            }
+            suspend(conf);
+        }
+
+        if (conf->end - conf->needle >= 3 && memcmp(conf->needle, "\xEF\xBB\xBF", 3) == 0)
+        {
+            conf->needle += 3;
         }
-        delete(unit, unit->punctuators, sizeof(unit->punctuators[0]) * unit->punctuators_count);
+        stream->started = true;
     }
 }
 
-void conf_free(conf_unit *unit)
+// Parses the buffered source text until it's exhausted. This returns only after the end of the
+// source text has been parsed; otherwise parsing is suspended or an error is reported.
+static void stream_parse(conf_stream *stream)
 {
-    if (unit != NULL)
+    stream_start(stream);
+    while (stream->state != STREAM_END)
     {
-        deinit_configuration_unit(unit);
-        delete(unit, unit, sizeof(unit[0]));
+        stream_step(stream);
     }
 }
 
-static void parse_configuration_unit(conf_unit *unit)
+static conf_errno stream_report(const conf_stream *stream, conf_error *error)
 {
-    // Skip past the a BOM (byte order mark) character if present.
-    if (memchr(unit->needle, '\0', 3) == NULL)
+    const conf_unit *conf = &stream->unit;
+    if (error != NULL)
     {
-        if (memcmp(unit->needle, "\xEF\xBB\xBF", 3) == 0)
+        if (conf->err.code == CONF_NO_ERROR)
         {
-            unit->needle += 3;
+            error->where = conf->base + (size_t)(conf->needle - conf->string);
+            error->code = CONF_NO_ERROR;
+            strcpy(error->description, "no error");
+        }
+        else
+        {
+            memcpy(error, &conf->err, sizeof(error[0]));
         }
     }
+    return conf->err.code;
+}
 
-    // Parse the Confetti configuration unit.
-    parse_body(unit, unit->root, 0);
-
-    // Verify the configuration unit ended by checking for extraneous tokens.
-    token tok;
-    peek(unit, &tok);
-    if (tok.type != TOK_EOF)
+static conf_errno stream_invalid_operation(conf_error *error, const char *description)
+{
+    if (error != NULL)
     {
-        assert(tok.type == '}');
-        die(unit, CONF_BAD_SYNTAX, unit->needle, "found '}' without matching '{'");
+        error->code = CONF_INVALID_OPERATION;
+        strcpy(error->description, description);
     }
+    return CONF_INVALID_OPERATION;
 }
 
-static conf_errno init_punctuator_arguments(conf_unit *unit, const char **punctuator_arguments)
+conf_stream *conf_stream_open(const conf_options *options, conf_error *error, conf_walkfn walk)
 {
-    struct counters
+    // Streams, like the configuration unit walker, report elements to a callback function.
+    if (walk == NULL)
     {
-        long unique_strings;
-        long buffer_length;
-        long buffer_offset;
-    };
-
-    uchar *starters = NULL;
-    struct counters *counters = NULL;
+        stream_invalid_operation(error, "missing function argument");
+        return NULL;
+    }
 
-    // Count how many punctuator arguments there are.
-    long count = 0;
-    size_t index = 0;
-    for (;;)
+    conf_unit tmp;
+    const conf_errno eno = init_configuration_unit(&tmp, "", 0, options, error, walk);
+    if (eno != CONF_NO_ERROR)
     {
-        const char *string = punctuator_arguments[index];
-        if (string == NULL)
-        {
-            break;
-        }
-        index += 1;
-
-        if (string[0] == '\0')
-        {
-            continue;
-        }
-        count += 1;
-
-        // Verify the string only contains valid argument characters; it
-        // cannot contain white space, reserved, or forbidden characters.
-        for (;;)
-        {
-            size_t byte_count = 0;
-            const uchar cp = utf8decode2(string, &byte_count);
-            if (cp == '\0')
-            {
-                break;
-            }
-            
-            if (cp == BAD_ENCODING)
-            {
-                unit->err.code = CONF_ILLEGAL_BYTE_SEQUENCE;
-                strcpy(unit->err.description, "punctuator argument with malformed UTF-8");
-                goto cleanup;
-            }
-
-            // If the expression arguments extension is enabled, then disallow parentheses
-            // as they reserved characters with the extension.
-            if (unit->extensions.expression_arguments)
-            {
-                if (cp == '(' || cp == ')')
-                {
-                    unit->err.code = CONF_INVALID_OPERATION;
-                    strcpy(unit->err.description, "illegal punctuator argument character");
-                    goto cleanup;
-                }
-            }
-
-            if ((conf_uniflags(cp) & IS_ARGUMENT_CHARACTER) == 0)
-            {
-                unit->err.code = CONF_INVALID_OPERATION;
-                strcpy(unit->err.description, "illegal punctuator argument character");
-                goto cleanup;
-            }
-
-            string += byte_count;
-        }
+        deinit_configuration_unit(&tmp);
+        return NULL;
     }
 
-    // If the array is empty, then there are no punctuators to add.
-    if (count == 0)
+    conf_stream *stream = new(&tmp, sizeof(stream[0]));
+    if (stream == NULL)
     {
-        return CONF_NO_ERROR;
+        if (error != NULL)
+        {
+            error->code = CONF_OUT_OF_MEMORY;
+            strcpy(error->description, "memory allocation failed");
+        }
+        deinit_configuration_unit(&tmp);
+        return NULL;
     }
+    memset(stream, 0, sizeof(stream[0]));
+    memcpy(&stream->unit, &tmp, sizeof(tmp));
+
+    // The source text hasn't been seen so it can't be searched for bidirectional characters
+    // ahead of time; instead every character is checked as it's scanned.
+    stream->unit.streaming = true;
+    stream->unit.check_bidi = !stream->unit.options.allow_bidi;
+    stream_report(stream, error);
+    return stream;
+}
 
-    // Create an array large enough to accommodate the unique starting character of each punctuator.
-    // The array might not be fully used if multiple punctuators begin with the same character.
-    starters = zero_new(unit, sizeof(starters[0]) * count);
-    if (starters == NULL)
+conf_errno conf_stream_feed(conf_stream *stream, const char *chunk, size_t length, conf_error *error)
+{
+    if (stream == NULL)
     {
-        unit->err.code = CONF_OUT_OF_MEMORY;
-        strcpy(unit->err.description, "memory allocation failed");
-        goto cleanup;
+        return stream_invalid_operation(error, "missing stream argument");
     }
-    unit->punctuator_starters = starters;
-    unit->punctuator_starters_size = sizeof(starters[0]) * count;
 
-    // Create a temporary array for counters.
-    counters = zero_new(unit, sizeof(counters[0]) * count);
-    if (counters == NULL)
+    if (chunk == NULL && length > 0)
     {
-        unit->err.code = CONF_OUT_OF_MEMORY;
-        strcpy(unit->err.description, "memory allocation failed");
-        goto cleanup;
+        return stream_invalid_operation(error, "missing string argument");
     }
 
-    // Count all unique starter characters.
-    size_t unique_starters = 0;
-    index = 0;
-    for (;;)
+    if (stream->finished)
     {
-        const char *string = punctuator_arguments[index];
-        if (string == NULL)
-        {
-            break;
-        }
-        index += 1;
-
-        const size_t length = strlen(string);
-        if (length == 0)
-        {
-            continue;
-        }
-
-        const uchar cp = utf8decode2(string, NULL);
-        struct counters *counter = counters;
-        uchar *starter = starters;
-        bool added = false;
-
-        // Check if this starting character is already in the starter set.
-        // This is an O(1) operation, but the assumption is (1) there won't be too many custom punctuators
-        // in real world applications and (2) the memory layout of this structure is fairly compact in memory.
-        for (size_t i = 0; i < unique_starters; i++, starter++, counter++)
-        {
-            if ((*starter) == cp)
-            {
-                counter->buffer_length += length + 1;
-                counter->unique_strings += 1;
-                added = true;
-                break;
-            }
-        }
-
-        // If this starter hasn't been registered yet, then register it.
-        if (!added)
-        {
-            (*starter) = cp;
-            counter->buffer_length = length + 1;
-            counter->unique_strings = 1;
-            unique_starters += 1;
-        }
+        return stream_invalid_operation(error, "stream is finished");
     }
-    assert(unique_starters > 0);
 
-    // Allocate an array large enough to accomidate pointers to each string for each unique starter.
-    struct punctset **punctuators = zero_new(unit, sizeof(punctuators[0]) * unique_starters);
-    if (punctuators == NULL)
+    // Once an error is reported the remainder of the stream is ignored.
+    conf_unit *conf = &stream->unit;
+    if (conf->err.code != CONF_NO_ERROR)
     {
-        unit->err.code = CONF_OUT_OF_MEMORY;
-        strcpy(unit->err.description, "memory allocation failed");
-        goto cleanup;
+        return stream_report(stream, error);
     }
-    unit->punctuators = punctuators;
-    unit->punctuators_count = unique_starters;
 
-    // Begin copying the punctuator data to a cache-friendly buffer.
-    index = 0;
-    for (;;)
+    // Setup exception-like handling for unrecoverable errors and suspended scanners.
+    switch (setjmp(conf->err_buf))
     {
-        const char *string = punctuator_arguments[index];
-        if (string == NULL)
-        {
-            break;
-        }
-        index += 1;
-
-        const size_t length = strlen(string);
-        if (length == 0)
+    case 0:
+        stream_append(stream, chunk, length);
+        if (stream->length >= stream->retry_length || !conf->streaming)
         {
-            continue;
-        }
-
-        const uchar cp = utf8decode2(string, NULL);
-        struct punctset *punct = NULL;
-        struct counters *counter = NULL;
-
-        // Check if this starting character is already in the starter set.
-        // This is an O(1) operation, but the assumption is (1) there won't be too many custom punctuators
-        // in real world applications and (2) the memory layout of this structure is fairly compact in memory.
-        for (size_t i = 0; i < unique_starters; i++) // LCOV_EXCL_BR_LINE: The number of starters is always non-zero.
-        {
-            if (starters[i] == cp)
-            {
-                if (punctuators[i] == NULL)
-                {
-                    counter = &counters[i];
-                    const size_t size = sizeof(punct[0]) + sizeof(punct[0].punctuators[0]) * counter->buffer_length;
-                    punct = zero_new(unit, size);
-                    if (punct == NULL)
-                    {
-                        unit->err.code = CONF_OUT_OF_MEMORY;
-                        strcpy(unit->err.description, "memory allocation failed");
-                        goto cleanup;
-                    }
-                    punct->length = counter->unique_strings;
-                    punct->size = size;
-                    punctuators[i] = punct;
-                }
-                else
-                {
-                    counter = &counters[i];
-                    punct = punctuators[i];
-                }
-                break;
-            }
+            stream_parse(stream);
         }
-        assert(punct != NULL);
-        assert(counter != NULL);
-
-        // Copy the punctuator to the cache-friendly buffer.
-        memcpy(&punct->punctuators[counter->buffer_offset], string, length + 1);
-        counter->buffer_offset += length + 1;
-    }
+        break;
 
-cleanup:
-    if (counters != NULL)
-    {
-        delete(unit, counters, sizeof(counters[0]) * count);
+    case STREAM_SUSPENDED:
+        conf->peek.type = TOK_INVALID;
+        stream_discard(stream);
+        stream->retry_length = stream->length + (size_t)(conf->end - conf->needle);
+        break;
     }
-    return unit->err.code;
+    return stream_report(stream, error);
 }
 
-// Initializes a Confetti configuration unit structure. This initilaization is common to both the walk() and parse() interfaces.
-static conf_errno init_configuration_unit(conf_unit *unit, const char *string, const conf_options *options, conf_error *error, conf_walkfn walk)
+conf_errno conf_stream_finish(conf_stream *stream, conf_error *error)
 {
-    memset(unit, 0, sizeof(unit[0]));
-    unit->string = string;
-    unit->needle = string;
-    unit->err.where = 0;
-    unit->err.code = CONF_NO_ERROR;
-    unit->walk = walk;
-
-    if (options != NULL)
+    if (stream == NULL)
     {
-        if (options->extensions != NULL)
-        {
-            unit->extensions = *options->extensions;
-        }
-        unit->options = *options;
+        return stream_invalid_operation(error, "missing stream argument");
     }
 
-    if (unit->options.max_depth < 1)
+    if (stream->finished)
     {
-        unit->options.max_depth = 20; // Default maximum nesting depth.
+        return stream_report(stream, error);
     }
 
-    if (unit->options.allocator == NULL)
+    stream->finished = true;
+    conf_unit *conf = &stream->unit;
+    if (conf->err.code != CONF_NO_ERROR)
     {
-        unit->options.allocator = &default_alloc;
+        return stream_report(stream, error);
     }
 
-    if (string == NULL)
+    // Setup exception-like handling for unrecoverable errors.
+    if (setjmp(conf->err_buf) == 0)
     {
-        if (error != NULL)
-        {
-            error->code = CONF_INVALID_OPERATION;
-            strcpy(error->description, "missing string argument");
-        }
-        return CONF_INVALID_OPERATION;
+        // The end of the buffered text is now the end of the source text.
+        conf->streaming = false;
+        stream_parse(stream);
     }
+    return stream_report(stream, error);
+}
 
-    if (unit->extensions.punctuator_arguments)
+void conf_stream_free(conf_stream *stream)
+{
+    if (stream != NULL)
     {
-        if (init_punctuator_arguments(unit, unit->extensions.punctuator_arguments) != CONF_NO_ERROR)
+        conf_unit *conf = &stream->unit;
+        if (stream->buffer != NULL)
         {
-            if (error != NULL)
-            {
-                memcpy(error, &unit->err, sizeof(unit->err));
-            }
-            return unit->err.code;
+            delete(conf, stream->buffer, stream->capacity);
         }
+        deinit_configuration_unit(conf);
+        delete(conf, stream, sizeof(stream[0]));
     }
+}
 
-    return CONF_NO_ERROR;
+conf_reader *conf_reader_open(const char *string, const conf_options *options, conf_error *error)
+{
+    return conf_reader_open_n(string, (string != NULL) ? strlen(string) : 0, options, error);
 }
 
-conf_unit *conf_parse(const char *string, const conf_options *options, conf_error *error)
+conf_reader *conf_reader_open_n(const char *string, size_t length, const conf_options *options, conf_error *error)
 {
-    conf_unit *unit = NULL, tmp;
-    const conf_errno eno = init_configuration_unit(&tmp, string, options, error, NULL);
+    // Readers have no walk callback so comments are collected, like they are when parsing, and
+    // they're read from the collection.
+    conf_unit tmp;
+    const conf_errno eno = init_configuration_unit(&tmp, string, length, options, error, NULL);
     if (eno != CONF_NO_ERROR)
     {
         deinit_configuration_unit(&tmp);
         return NULL;
     }
 
-    // Allocate the top-level directive and then begin parsing.
-    unit = new(&tmp, sizeof(tmp));
-    if (unit == NULL)
+    conf_reader *reader = new(&tmp, sizeof(reader[0]));
+    if (reader == NULL)
     {
         if (error != NULL)
         {
@@ -1949,87 +4500,76 @@ conf_unit *conf_parse(const char *string, const conf_options *options, conf_erro
         deinit_configuration_unit(&tmp);
         return NULL;
     }
-    memcpy(unit, &tmp, sizeof(unit[0]));
-    unit->root = (conf_directive *)unit->padding;
+    memset(reader, 0, sizeof(reader[0]));
+    memcpy(&reader->stream.unit, &tmp, sizeof(tmp));
+    stream_report(&reader->stream, error);
+    return reader;
+}
 
-    // Setup exception-like handling for unrecoverable errors.
-    if (setjmp(unit->err_buf) != 0)
+bool conf_reader_next(conf_reader *reader, conf_event *event)
+{
+    if (reader == NULL || event == NULL)
     {
-        if (error != NULL)
-        {
-            memcpy(error, &unit->err, sizeof(error[0]));
-        }
-        conf_free(unit);
-        return NULL;
+        return false;
     }
-    parse_configuration_unit(unit);
 
-    // Convert the comments linked list to an array for O(1) access.
-    if (unit->comments_count > 0)
+    conf_stream *stream = &reader->stream;
+    conf_unit *conf = &stream->unit;
+    for (;;)
     {
-        struct comment **comments = new(unit, sizeof(comments[0]) * unit->comments_count);
-        if (comments == NULL)
+        // Comments are found while looking for the next token so they precede the element
+        // found by the same step.
+        if (reader->next_comment < conf->tree_comments_count)
         {
-            die(unit, CONF_OUT_OF_MEMORY, unit->needle, "memory allocation failed");
+            event->element = CONF_COMMENT;
+            event->argc = 0;
+            event->argv = NULL;
+            event->comment = conf->tree_comments[reader->next_comment++];
+            return true;
         }
 
-        // Copy subdirective pointers to the array.
-        long index = 0;
-        for (struct comment *curr = unit->comment_head; curr != NULL; curr = curr->next)
+        if (stream->has_element)
         {
-            comments[index] = curr;
-            index += 1;
+            stream->has_element = false;
+            event->element = stream->element;
+            event->argc = (stream->element == CONF_DIRECTIVE) ? stream->argc : 0;
+            event->argv = (stream->element == CONF_DIRECTIVE) ? conf->argv : NULL;
+            event->comment = (conf_comment){0};
+            return true;
         }
-        unit->comments = comments;
-    }
 
-    if (error != NULL)
-    {
-        error->where = unit->needle - unit->string;
-        error->code = CONF_NO_ERROR;
-        strcpy(error->description, "no error");
-    }
-    return unit;
-}
+        if (stream->state == STREAM_END || conf->err.code != CONF_NO_ERROR)
+        {
+            return false;
+        }
 
-conf_errno conf_walk(const char *string, const conf_options *options, conf_error *error, conf_walkfn walk)
-{
-    // The configuration unit walker interface requires a callback function to invoke
-    // when an "interesting" configuration unit element is found, e.g. a directive.
-    if (walk == NULL)
-    {
-        if (error != NULL)
+        // Setup exception-like handling for unrecoverable errors. Elements found before the
+        // error are still read, but nothing after it.
+        conf->tree_comments_count = 0;
+        reader->next_comment = 0;
+        if (setjmp(conf->err_buf) == 0)
         {
-            error->code = CONF_INVALID_OPERATION;
-            strcpy(error->description, "missing function argument");
+            stream_start(stream);
+            stream_step(stream);
         }
-        return CONF_INVALID_OPERATION;
     }
+}
 
-    conf_unit unit;
-    const conf_errno eno = init_configuration_unit(&unit, string, options, error, walk);
-    if (eno != CONF_NO_ERROR)
+conf_errno conf_reader_error(const conf_reader *reader, conf_error *error)
+{
+    if (reader == NULL)
     {
-        deinit_configuration_unit(&unit);
-        return eno;
+        return stream_invalid_operation(error, "missing reader argument");
     }
+    return stream_report(&reader->stream, error);
+}
 
-    // Setup exception-like handling for unrecoverable errors.
-    if (setjmp(unit.err_buf) == 0)
-    {
-        parse_configuration_unit(&unit);
-        if (error != NULL)
-        {
-            error->where = unit.needle - unit.string;
-            error->code = CONF_NO_ERROR;
-            strcpy(error->description, "no error");
-        }
-    }
-    else if (error != NULL)
+void conf_reader_free(conf_reader *reader)
+{
+    if (reader != NULL)
     {
-        memcpy(error, &unit.err, sizeof(error[0]));
+        conf_unit *conf = &reader->stream.unit;
+        deinit_configuration_unit(conf);
+        delete(conf, reader, sizeof(reader[0]));
     }
-
-    deinit_configuration_unit(&unit);
-    return unit.err.code;
 }
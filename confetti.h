@@ -17,6 +17,9 @@ typedef void *(*conf_allocfn)(void *user_data, void *ptr, size_t size);
 
 typedef struct conf_unit conf_unit; // Configuration Unit.
 typedef struct conf_directive conf_directive; // Configuration Directive.
+typedef struct conf_stream conf_stream; // Configuration Unit Stream.
+typedef struct conf_reader conf_reader; // Configuration Unit Reader.
+typedef struct conf_syntax conf_syntax; // Compiled Syntax.
 
 // This struct is for enabling Confetti extensions as defined in the Annex of the Confetti specification.
 typedef struct conf_extensions
@@ -33,6 +36,10 @@ typedef struct conf_options
     void *user_data;
     int max_depth; // Defaults to 20 (for a "safe" default). Raise or lower as needed.
     bool allow_bidi;
+    bool force_scalar; // Disables the vectorized scanning kernels, e.g. for reproducible debugging.
+    bool discard_comments; // Comments are neither recorded by conf_parse() nor reported by conf_walk().
+    bool argument_views; // Values without escape sequences point into the source text and aren't null terminated.
+    const conf_syntax *syntax; // Compiled with conf_syntax_compile(); replaces 'extensions' and 'force_scalar' if set.
 } conf_options;
 
 typedef enum conf_errno
@@ -44,6 +51,7 @@ typedef enum conf_errno
     CONF_INVALID_OPERATION,
     CONF_MAX_DEPTH_EXCEEDED,
     CONF_USER_ABORTED,
+    CONF_IO_ERROR,
 } conf_errno;
 
 typedef struct conf_error
@@ -59,6 +67,7 @@ typedef struct conf_argument
     size_t lexeme_offset; // UTF-8 code unit index.
     size_t lexeme_length; // UTF-8 code unit count.
     bool is_expression; // True if this is an expression argument extension according to Annex B.
+    size_t value_length; // UTF-8 code unit count, excluding the null terminator if there is one.
 } conf_argument;
 
 typedef struct conf_comment
@@ -77,9 +86,38 @@ typedef enum conf_element
 
 typedef int (*conf_walkfn)(void *user_data, conf_element element, int argc, const conf_argument *argv, const conf_comment *comment);
 
+conf_syntax *conf_syntax_compile(const conf_options *options, conf_error *error);
+void conf_syntax_free(conf_syntax *syntax);
+
 conf_errno conf_walk(const char *string, const conf_options *options, conf_error *error, conf_walkfn walk);
+conf_errno conf_walk_n(const char *string, size_t length, const conf_options *options, conf_error *error, conf_walkfn walk);
+conf_errno conf_walk_file(const char *path, const conf_options *options, conf_error *error, conf_walkfn walk);
+
+conf_stream *conf_stream_open(const conf_options *options, conf_error *error, conf_walkfn walk);
+conf_errno conf_stream_feed(conf_stream *stream, const char *chunk, size_t length, conf_error *error);
+conf_errno conf_stream_finish(conf_stream *stream, conf_error *error);
+void conf_stream_free(conf_stream *stream);
+
+typedef struct conf_event
+{
+    conf_element element;
+    int argc; // Number of directive arguments.
+    const conf_argument *argv; // Directive arguments, which are valid until the next event is read.
+    conf_comment comment; // Location of the comment if the element is a comment.
+} conf_event;
+
+conf_reader *conf_reader_open(const char *string, const conf_options *options, conf_error *error);
+conf_reader *conf_reader_open_n(const char *string, size_t length, const conf_options *options, conf_error *error);
+bool conf_reader_next(conf_reader *reader, conf_event *event);
+conf_errno conf_reader_error(const conf_reader *reader, conf_error *error);
+void conf_reader_free(conf_reader *reader);
 
 conf_unit *conf_parse(const char *string, const conf_options *options, conf_error *error);
+conf_unit *conf_parse_n(const char *string, size_t length, const conf_options *options, conf_error *error);
+conf_unit *conf_parse_insitu(char *string, const conf_options *options, conf_error *error);
+conf_unit *conf_parse_file(const char *path, const conf_options *options, conf_error *error);
+size_t conf_measure(const char *string, size_t length, const conf_options *options, conf_error *error);
+conf_unit *conf_parse_into(void *buffer, size_t size, const char *string, size_t length, const conf_options *options, conf_error *error);
 void conf_free(conf_unit *unit);
 
 const conf_comment *conf_get_comment(const conf_unit *unit, long index);
@@ -22,5 +22,9 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
     conf_unit *conf = conf_parse(string, NULL, &error);
     conf_free(conf);
     free(string);
+
+    // Parse the input data as-is to verify the parser doesn't read past the end of it.
+    conf = conf_parse_n((const char *)data, size, NULL, &error);
+    conf_free(conf);
     return 0;
 }
@@ -26,5 +26,20 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
     conf_error error = {0};
     conf_walk(string, NULL, &error, callback);
     free(string);
+
+    // Walk the input data as-is to verify the parser doesn't read past the end of it.
+    conf_walk_n((const char *)data, size, NULL, &error, callback);
+
+    // Stream the input data one byte at a time to verify the parser resumes at every position.
+    conf_stream *stream = conf_stream_open(NULL, &error, callback);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (conf_stream_feed(stream, (const char *)&data[i], 1, &error) != CONF_NO_ERROR)
+        {
+            break;
+        }
+    }
+    conf_stream_finish(stream, &error);
+    conf_stream_free(stream);
     return 0;
 }
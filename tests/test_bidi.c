@@ -11,6 +11,7 @@
 
 #include "confetti.h"
 #include "test_utils.h"
+#include <string.h>
 #include <audition.h>
 
 static const char *const bidi_chars[] = {
@@ -111,3 +112,41 @@ TEST(bidi, disallowed_in_expression_arguments)
     ASSERT_EQ(err.where, 2);
     ASSERT_STR_EQ(err.description, "illegal bidirectional character");
 }
+
+//
+// Bidirectional characters are detected ahead of time, but must still be reported in source order.
+//
+
+TEST(bidi, disallowed_after_long_argument, .iterations=64)
+{
+    char input[128] = {0};
+    memset(input, 'x', (size_t)TEST_ITERATION + 1);
+    strcat(input, "\u202E");
+
+    conf_options opts = {.allow_bidi=false};
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, &opts, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, TEST_ITERATION + 1);
+    ASSERT_STR_EQ(err.description, "illegal bidirectional character");
+}
+
+TEST(bidi, disallowed_after_syntax_error)
+{
+    conf_options opts = {.allow_bidi=false};
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse("foo }\nbar \u202E", &opts, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, 4);
+}
+
+TEST(bidi, similar_characters_allowed)
+{
+    // These characters share the same leading bytes as bidirectional characters.
+    conf_options opts = {.allow_bidi=false};
+    conf_error err = {0};
+    conf_unit *unit = conf_parse("\u2010 \u2020 \u2030 \u2040 \u2070 \u20AC", &opts, &err);
+    ASSERT_NONNULL(unit);
+    ASSERT_EQ(conf_get_argument_count(conf_get_directive(conf_get_root(unit), 0)), 6);
+    conf_free(unit);
+}
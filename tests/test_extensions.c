@@ -142,3 +142,50 @@ TEST(conf_parse, punctuator_argument_with_malformed_unicode)
     ASSERT_STR_EQ("punctuator argument with malformed UTF-8", err.description);
     conf_free(dir);
 }
+
+TEST(conf_parse, longest_punctuator_argument_is_matched)
+{
+    // The input "==" is not a punctuator, but its prefix "=" is.
+    const char *punctuators[] = {"===", "=", "!=", "!", "\xC3\xA9=", NULL};
+    const conf_extensions exts = {
+        .punctuator_arguments = punctuators,
+    };
+    const conf_options opts = {
+        .extensions = &exts,
+    };
+    conf_error err = {0};
+    conf_unit *dir = conf_parse("a===b==c!=!\xC3\xA9=\xC3\xA9", &opts, &err);
+    ASSERT_NONNULL(dir);
+
+    const char *expected[] = {"a", "===", "b", "=", "=", "c", "!=", "!", "\xC3\xA9=", "\xC3\xA9"};
+    const conf_directive *directive = conf_get_directive(conf_get_root(dir), 0);
+    ASSERT_EQ(conf_get_argument_count(directive), COUNT_OF(expected));
+    for (long i = 0; i < (long)COUNT_OF(expected); i++)
+    {
+        ASSERT_STR_EQ(conf_get_argument(directive, i)->value, expected[i]);
+    }
+    conf_free(dir);
+}
+
+TEST(conf_parse, punctuator_argument_sharing_comment_starter)
+{
+    const char *punctuators[] = {"/", "/=", NULL};
+    const conf_extensions exts = {
+        .punctuator_arguments = punctuators,
+        .c_style_comments = true,
+    };
+    const conf_options opts = {
+        .extensions = &exts,
+    };
+    conf_error err = {0};
+    conf_unit *dir = conf_parse("a / b /= c // d\n/* e */ f", &opts, &err);
+    ASSERT_NONNULL(dir);
+    ASSERT_EQ(conf_get_comment_count(dir), 2);
+
+    const conf_directive *root = conf_get_root(dir);
+    ASSERT_EQ(conf_get_directive_count(root), 2);
+    ASSERT_EQ(conf_get_argument_count(conf_get_directive(root, 0)), 5);
+    ASSERT_STR_EQ(conf_get_argument(conf_get_directive(root, 0), 3)->value, "/=");
+    ASSERT_STR_EQ(conf_get_argument(conf_get_directive(root, 1), 0)->value, "f");
+    conf_free(dir);
+}
@@ -53,7 +53,14 @@ static void print_directive(struct StringBuf *sb, const conf_directive *dir, int
     strbuf_puts(sb, "]");
 }
 
-static char *parse(const char *input, const conf_extensions *extensions)
+enum parser
+{
+    PARSE_STRING, // Parse with conf_parse().
+    PARSE_INTO_BUFFER, // Measure the unit and build it in a buffer of exactly that size.
+    PARSE_WITH_SYNTAX, // Compile the syntax up front and parse with conf_parse().
+};
+
+static char *parse(const char *input, const conf_extensions *extensions, enum parser parser)
 {
     conf_error error = {0};
     conf_options options = {
@@ -61,7 +68,31 @@ static char *parse(const char *input, const conf_extensions *extensions)
     };
 
     StringBuf *sb = strbuf_new();
-    conf_unit *unit = conf_parse(input, &options, &error);
+    conf_unit *unit = NULL;
+    conf_syntax *syntax = NULL;
+    void *buffer = NULL;
+    if (parser == PARSE_WITH_SYNTAX)
+    {
+        syntax = conf_syntax_compile(&options, &error);
+        if (syntax != NULL)
+        {
+            options.syntax = syntax;
+            unit = conf_parse(input, &options, &error);
+        }
+    }
+    else if (parser == PARSE_INTO_BUFFER)
+    {
+        const size_t size = conf_measure(input, strlen(input), &options, &error);
+        if (size > 0)
+        {
+            buffer = malloc(size);
+            unit = conf_parse_into(buffer, size, input, strlen(input), &options, &error);
+        }
+    }
+    else
+    {
+        unit = conf_parse(input, &options, &error);
+    }
     if (error.code != CONF_NO_ERROR)
     {
         assert(unit == NULL);
@@ -79,6 +110,8 @@ static char *parse(const char *input, const conf_extensions *extensions)
         }
         conf_free(unit);
     }
+    conf_syntax_free(syntax);
+    free(buffer);
     return strbuf_drop(sb);
 }
 
@@ -87,7 +120,27 @@ TEST(parser, pretty_print, .iterations=COUNT_OF(tests_utf8))
     const struct TestData *td = &tests_utf8[TEST_ITERATION];
     const char *input = (const char *)td->input;
     const char *output = (const char *)td->output;
-    char *actual = parse(input, &td->extensions);
+    char *actual = parse(input, &td->extensions, PARSE_STRING);
+    EXPECT_STR_EQ(output, actual, "snapshots do not match: %s", td->name);
+    free(actual);
+}
+
+TEST(parser, pretty_print_into_buffer, .iterations=COUNT_OF(tests_utf8))
+{
+    const struct TestData *td = &tests_utf8[TEST_ITERATION];
+    const char *input = (const char *)td->input;
+    const char *output = (const char *)td->output;
+    char *actual = parse(input, &td->extensions, PARSE_INTO_BUFFER);
+    EXPECT_STR_EQ(output, actual, "snapshots do not match: %s", td->name);
+    free(actual);
+}
+
+TEST(parser, pretty_print_with_syntax, .iterations=COUNT_OF(tests_utf8))
+{
+    const struct TestData *td = &tests_utf8[TEST_ITERATION];
+    const char *input = (const char *)td->input;
+    const char *output = (const char *)td->output;
+    char *actual = parse(input, &td->extensions, PARSE_WITH_SYNTAX);
     EXPECT_STR_EQ(output, actual, "snapshots do not match: %s", td->name);
     free(actual);
 }
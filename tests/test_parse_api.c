@@ -10,6 +10,9 @@
 // For example, calling a function with a null argument to verify it handles it correctly.
 
 #include "confetti.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <audition.h>
 
 TEST(conf_parse, null_arguments)
@@ -59,6 +62,137 @@ TEST(conf_parse, low_max_depth)
     ASSERT_STR_EQ("maximum nesting depth exceeded", err.description);
 }
 
+TEST(conf_parse, many_arguments_with_continuations)
+{
+    // More arguments than the initial token buffer holds, with escapes and a line continuation.
+    const char *expected[] = {"a", "bc", "d\"e", "f", "g", "h", "i", "j", "k"};
+    conf_unit *unit = conf_parse("a b\\c \"d\\\"e\" f g h i \\\n  j k # comment\nl\n", NULL, NULL);
+    ASSERT_NONNULL(unit);
+    ASSERT_EQ(conf_get_comment_count(unit), 1);
+
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 9);
+    for (long i = 0; i < 9; i++)
+    {
+        ASSERT_STR_EQ(conf_get_argument(dir, i)->value, expected[i]);
+    }
+    conf_free(unit);
+}
+
+TEST(conf_parse, discard_comments)
+{
+    conf_options opts = {.discard_comments = true};
+    conf_unit *unit = conf_parse("# one\nfoo # two\nbar\n", &opts, NULL);
+    ASSERT_NONNULL(unit);
+    ASSERT_EQ(conf_get_comment_count(unit), 0);
+    ASSERT_NULL(conf_get_comment(unit, 0));
+    ASSERT_EQ(conf_get_directive_count(conf_get_root(unit)), 2);
+    conf_free(unit);
+}
+
+TEST(conf_parse_n, stops_at_length)
+{
+    // Only the first three bytes are parsed; the rest must not be read.
+    conf_unit *unit = conf_parse_n("foo\"bar", 3, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 1);
+    ASSERT_STR_EQ(conf_get_argument(dir, 0)->value, "foo");
+    conf_free(unit);
+}
+
+TEST(conf_parse_n, sequence_cut_short_by_length)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_n("foo \xC3\xA9", 5, NULL, &err));
+    ASSERT_EQ(CONF_ILLEGAL_BYTE_SEQUENCE, err.code);
+    ASSERT_EQ(err.where, 4);
+}
+
+TEST(conf_parse_n, embedded_null_character)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_n("foo\0bar", 7, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, 3);
+    ASSERT_STR_EQ("illegal character U+0000", err.description);
+}
+
+TEST(conf_parse_n, null_character_inside_block)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_n("foo {\0}\n", 8, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, 5);
+    ASSERT_STR_EQ("illegal character U+0000", err.description);
+}
+
+TEST(conf_parse_n, null_character_inside_quoted_argument)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_n("foo \"a\0b\"", 9, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, 6);
+    ASSERT_STR_EQ("illegal character U+0000", err.description);
+}
+
+static void assert_same_directive(const conf_directive *expected, const conf_directive *actual)
+{
+    ASSERT_EQ(conf_get_argument_count(expected), conf_get_argument_count(actual));
+    for (long i = 0; i < conf_get_argument_count(expected); i++)
+    {
+        ASSERT_STR_EQ(conf_get_argument(expected, i)->value, conf_get_argument(actual, i)->value);
+    }
+
+    ASSERT_EQ(conf_get_directive_count(expected), conf_get_directive_count(actual));
+    for (long i = 0; i < conf_get_directive_count(expected); i++)
+    {
+        assert_same_directive(conf_get_directive(expected, i), conf_get_directive(actual, i));
+    }
+}
+
+TEST(conf_parse_file, same_as_string)
+{
+    const char *path = PATH_TO_CORPUS "/application_settings.conf";
+    FILE *file = fopen(path, "rb");
+    ASSERT_NONNULL(file);
+    char *string = calloc(1, 1 << 16);
+    ASSERT_NONNULL(string);
+    fread(string, 1, (1 << 16) - 1, file);
+    fclose(file);
+
+    conf_error err = {0};
+    conf_unit *expected = conf_parse(string, NULL, &err);
+    ASSERT_NONNULL(expected);
+    conf_unit *actual = conf_parse_file(path, NULL, &err);
+    ASSERT_NONNULL(actual);
+    ASSERT_EQ(CONF_NO_ERROR, err.code);
+
+    assert_same_directive(conf_get_root(expected), conf_get_root(actual));
+    ASSERT_EQ(conf_get_comment_count(expected), conf_get_comment_count(actual));
+
+    conf_free(expected);
+    conf_free(actual);
+    free(string);
+}
+
+TEST(conf_parse_file, missing_file)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_file(PATH_TO_CORPUS "/does_not_exist.conf", NULL, &err));
+    ASSERT_EQ(CONF_IO_ERROR, err.code);
+    ASSERT_EQ(err.where, 0);
+    ASSERT_STR_EQ("failed to open file", err.description);
+}
+
+TEST(conf_parse_file, null_path_argument)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse_file(NULL, NULL, &err));
+    ASSERT_EQ(CONF_INVALID_OPERATION, err.code);
+    ASSERT_STR_EQ("missing path argument", err.description);
+}
+
 TEST(conf_get_root, null_confetti)
 {
     ASSERT_NULL(conf_get_root(NULL));
@@ -92,6 +226,168 @@ TEST(conf_get_directive, out_of_bounds)
     conf_free(unit);
 }
 
+TEST(conf_parse, argument_views)
+{
+    const char *string = "foo \"bar baz\" qu\\x";
+    conf_options opts = {.argument_views = true};
+    conf_unit *unit = conf_parse(string, &opts, NULL);
+    ASSERT_NONNULL(unit);
+
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_NONNULL(dir);
+    ASSERT_EQ(conf_get_argument_count(dir), 3);
+
+    // Arguments without escape sequences are viewed in the source text.
+    const conf_argument *arg = conf_get_argument(dir, 0);
+    ASSERT_EQ(arg->value, &string[0]);
+    ASSERT_EQ(arg->value_length, 3);
+
+    arg = conf_get_argument(dir, 1);
+    ASSERT_EQ(arg->value, &string[5]);
+    ASSERT_EQ(arg->value_length, 7);
+
+    // Arguments with escape sequences are copied.
+    arg = conf_get_argument(dir, 2);
+    ASSERT_STR_EQ("qux", arg->value);
+    ASSERT_EQ(arg->value_length, 3);
+    conf_free(unit);
+}
+
+TEST(conf_parse_insitu, values_are_in_the_buffer)
+{
+    char string[] = "foo \"b\\\"ar\" baz;\nqu\\x\n";
+    conf_unit *unit = conf_parse_insitu(string, NULL, NULL);
+    ASSERT_NONNULL(unit);
+
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 3);
+    ASSERT_EQ(conf_get_argument(dir, 0)->value, &string[0]);
+    ASSERT_STR_EQ("foo", conf_get_argument(dir, 0)->value);
+    ASSERT_EQ(conf_get_argument(dir, 1)->value, &string[4]);
+    ASSERT_STR_EQ("b\"ar", conf_get_argument(dir, 1)->value);
+    ASSERT_EQ(conf_get_argument(dir, 1)->lexeme_length, 7);
+    ASSERT_EQ(conf_get_argument(dir, 2)->value, &string[12]);
+    ASSERT_STR_EQ("baz", conf_get_argument(dir, 2)->value);
+
+    dir = conf_get_directive(conf_get_root(unit), 1);
+    ASSERT_EQ(conf_get_argument(dir, 0)->value, &string[17]);
+    ASSERT_STR_EQ("qux", conf_get_argument(dir, 0)->value);
+    conf_free(unit);
+}
+
+TEST(conf_parse_insitu, adjacent_arguments_are_copied)
+{
+    static const char *punctuators[] = {"=", NULL};
+    conf_extensions extensions = {.punctuator_arguments = punctuators};
+    conf_options opts = {.extensions = &extensions};
+    char string[] = "x=y";
+    conf_unit *unit = conf_parse_insitu(string, &opts, NULL);
+    ASSERT_NONNULL(unit);
+
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 3);
+    ASSERT_STR_EQ("x", conf_get_argument(dir, 0)->value);
+    ASSERT_STR_EQ("=", conf_get_argument(dir, 1)->value);
+    ASSERT_STR_EQ("y", conf_get_argument(dir, 2)->value);
+    ASSERT_EQ(conf_get_argument(dir, 2)->value, &string[2]);
+    conf_free(unit);
+}
+
+TEST(conf_parse_into, buffer_of_measured_size)
+{
+    const char *string = "foo bar # comment\nbaz { qux }\n";
+    conf_error error = {0};
+    const size_t size = conf_measure(string, strlen(string), NULL, &error);
+    ASSERT_EQ(error.code, CONF_NO_ERROR);
+    ASSERT_GT(size, 0);
+
+    void *buffer = malloc(size);
+    for (int reload = 0; reload < 2; reload++)
+    {
+        conf_unit *unit = conf_parse_into(buffer, size, string, strlen(string), NULL, &error);
+        ASSERT_NONNULL(unit);
+        ASSERT_EQ(error.code, CONF_NO_ERROR);
+        ASSERT_EQ(conf_get_comment_count(unit), 1);
+
+        const conf_directive *dir = conf_get_directive(conf_get_root(unit), 1);
+        ASSERT_STR_EQ("baz", conf_get_argument(dir, 0)->value);
+        ASSERT_STR_EQ("qux", conf_get_argument(conf_get_directive(dir, 0), 0)->value);
+        ASSERT_GTEQ((const char *)conf_get_argument(dir, 0)->value, (const char *)buffer);
+        ASSERT_LT((const char *)conf_get_argument(dir, 0)->value, (const char *)buffer + size);
+    }
+    free(buffer);
+}
+
+TEST(conf_parse_into, buffer_too_small)
+{
+    const char *string = "foo bar";
+    const size_t size = conf_measure(string, strlen(string), NULL, NULL);
+    void *buffer = malloc(size);
+    conf_error error = {0};
+    ASSERT_NULL(conf_parse_into(buffer, size - 1, string, strlen(string), NULL, &error));
+    ASSERT_EQ(error.code, CONF_OUT_OF_MEMORY);
+    free(buffer);
+}
+
+TEST(conf_parse_into, null_buffer_argument)
+{
+    conf_error error = {0};
+    ASSERT_NULL(conf_parse_into(NULL, 0, "foo", 3, NULL, &error));
+    ASSERT_EQ(error.code, CONF_INVALID_OPERATION);
+}
+
+TEST(conf_measure, bad_syntax)
+{
+    conf_error error = {0};
+    ASSERT_EQ(conf_measure("foo }", 5, NULL, &error), 0);
+    ASSERT_EQ(error.code, CONF_BAD_SYNTAX);
+    ASSERT_EQ(error.where, 4);
+}
+
+TEST(conf_syntax_compile, shared_by_units)
+{
+    static const char *punctuators[] = {":=", NULL};
+    conf_extensions extensions = {.punctuator_arguments = punctuators};
+    conf_options opts = {.extensions = &extensions};
+    conf_syntax *syntax = conf_syntax_compile(&opts, NULL);
+    ASSERT_NONNULL(syntax);
+
+    // The extensions of the options are replaced by those of the syntax.
+    conf_options syntax_opts = {.syntax = syntax};
+    conf_unit *first = conf_parse("x:=y", &syntax_opts, NULL);
+    conf_unit *second = conf_parse("z := w", &syntax_opts, NULL);
+    ASSERT_NONNULL(first);
+    ASSERT_NONNULL(second);
+    ASSERT_EQ(conf_get_argument_count(conf_get_directive(conf_get_root(first), 0)), 3);
+    ASSERT_STR_EQ(":=", conf_get_argument(conf_get_directive(conf_get_root(second), 0), 1)->value);
+    conf_free(first);
+    conf_free(second);
+
+    const char *string = "a:=b";
+    const size_t size = conf_measure(string, strlen(string), &syntax_opts, NULL);
+    void *buffer = malloc(size);
+    conf_unit *unit = conf_parse_into(buffer, size, string, strlen(string), &syntax_opts, NULL);
+    ASSERT_NONNULL(unit);
+    ASSERT_STR_EQ("b", conf_get_argument(conf_get_directive(conf_get_root(unit), 0), 2)->value);
+    free(buffer);
+    conf_syntax_free(syntax);
+}
+
+TEST(conf_syntax_compile, illegal_punctuator)
+{
+    static const char *punctuators[] = {"{", NULL};
+    conf_extensions extensions = {.punctuator_arguments = punctuators};
+    conf_options opts = {.extensions = &extensions};
+    conf_error error = {0};
+    ASSERT_NULL(conf_syntax_compile(&opts, &error));
+    ASSERT_EQ(error.code, CONF_INVALID_OPERATION);
+}
+
+TEST(conf_syntax_free, null_syntax)
+{
+    conf_syntax_free(NULL);
+}
+
 TEST(conf_get_directive_count, null_directive)
 {
     ASSERT_EQ(conf_get_directive_count(NULL), 0);
@@ -0,0 +1,387 @@
+/*
+ * Confetti: a configuration language and parser library
+ * Copyright (c) 2025-2026 Confetti Contributors
+ *
+ * This file is part of Confetti, distributed under the MIT License
+ * For full terms see the included LICENSE file.
+ */
+
+// This source file tests the scanner with long runs of characters. The scanner skips runs of
+// ASCII characters in blocks so these tests place "interesting" characters at every position
+// within, and across, block boundaries to verify nothing is skipped that shouldn't be.
+
+#include "confetti.h"
+#include "test_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <audition.h>
+
+#define MAX_RUN_LENGTH 100
+
+static char *repeat(char ch, size_t count)
+{
+    char *string = malloc(count + 1);
+    memset(string, ch, count);
+    string[count] = '\0';
+    return string;
+}
+
+TEST(scanner, argument_terminated_by_quoted_argument, .iterations=MAX_RUN_LENGTH)
+{
+    const size_t length = TEST_ITERATION + 1;
+    char *expected = repeat('a', length);
+    char input[MAX_RUN_LENGTH + 16];
+    snprintf(input, sizeof(input), "%s\"q\"", expected);
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 2);
+    ASSERT_STR_EQ(conf_get_argument(dir, 0)->value, expected);
+    ASSERT_STR_EQ(conf_get_argument(dir, 1)->value, "q");
+    conf_free(unit);
+    free(expected);
+}
+
+TEST(scanner, argument_with_escape_sequence, .iterations=MAX_RUN_LENGTH - 1)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[TEST_ITERATION] = '\\';
+    input[MAX_RUN_LENGTH] = '\0';
+
+    char expected[MAX_RUN_LENGTH + 16];
+    memset(expected, 'a', MAX_RUN_LENGTH - 1);
+    expected[MAX_RUN_LENGTH - 1] = '\0';
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 1);
+    ASSERT_STR_EQ(conf_get_argument(dir, 0)->value, expected);
+    conf_free(unit);
+}
+
+TEST(scanner, argument_with_multi_byte_character, .iterations=MAX_RUN_LENGTH - 1)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    memcpy(&input[TEST_ITERATION], "\xC3\xA9", 2); // U+00E9
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 1);
+    ASSERT_STR_EQ(conf_get_argument(dir, 0)->value, input);
+    conf_free(unit);
+}
+
+TEST(scanner, argument_with_control_character, .iterations=MAX_RUN_LENGTH)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[TEST_ITERATION] = 0x7F;
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION);
+}
+
+TEST(scanner, argument_with_punctuator, .iterations=MAX_RUN_LENGTH)
+{
+    const char *punctuators[] = {"=", "+=", NULL};
+    const conf_extensions exts = {.punctuator_arguments = punctuators};
+    const conf_options opts = {.extensions = &exts};
+
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[TEST_ITERATION] = '=';
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_unit *unit = conf_parse(input, &opts, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    const long expected_count = 1 + (TEST_ITERATION > 0) + (TEST_ITERATION < MAX_RUN_LENGTH - 1);
+    ASSERT_EQ(conf_get_argument_count(dir), expected_count);
+    if (TEST_ITERATION > 0)
+    {
+        ASSERT_EQ(conf_get_argument(dir, 0)->lexeme_length, (size_t)TEST_ITERATION);
+    }
+    conf_free(unit);
+}
+
+TEST(scanner, argument_with_expression, .iterations=MAX_RUN_LENGTH)
+{
+    const conf_extensions exts = {.expression_arguments = true};
+    const conf_options opts = {.extensions = &exts};
+
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH + 1);
+    memcpy(&input[TEST_ITERATION], "()", 2);
+    input[MAX_RUN_LENGTH + 1] = '\0';
+
+    conf_unit *unit = conf_parse(input, &opts, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument(dir, 0)->is_expression, TEST_ITERATION == 0);
+    conf_free(unit);
+}
+
+TEST(scanner, white_space_run, .iterations=MAX_RUN_LENGTH)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, ' ', MAX_RUN_LENGTH);
+    memcpy(input, "foo", 3);
+    input[TEST_ITERATION / 2 + 3] = '\t';
+    memcpy(&input[MAX_RUN_LENGTH], "bar", 4);
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 2);
+    ASSERT_EQ(conf_get_argument(dir, 1)->lexeme_offset, MAX_RUN_LENGTH);
+    conf_free(unit);
+}
+
+TEST(scanner, white_space_run_with_multi_byte_white_space, .iterations=MAX_RUN_LENGTH - 3)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, '\t', MAX_RUN_LENGTH);
+    memcpy(&input[TEST_ITERATION], "\xE2\x80\x80", 3); // U+2000
+    memcpy(&input[MAX_RUN_LENGTH], "bar", 4);
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 1);
+    ASSERT_EQ(conf_get_argument(dir, 0)->lexeme_offset, MAX_RUN_LENGTH);
+    conf_free(unit);
+}
+
+TEST(scanner, single_line_comment_run, .iterations=MAX_RUN_LENGTH - 4)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'x', MAX_RUN_LENGTH);
+    input[0] = '#';
+    memcpy(&input[TEST_ITERATION + 1], "\nfoo", 4);
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    ASSERT_EQ(conf_get_comment_count(unit), 1);
+    ASSERT_EQ(conf_get_comment(unit, 0)->length, (size_t)TEST_ITERATION + 1);
+    ASSERT_EQ(conf_get_directive_count(conf_get_root(unit)), 1);
+    conf_free(unit);
+}
+
+TEST(scanner, single_line_comment_with_control_character, .iterations=MAX_RUN_LENGTH - 1)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'x', MAX_RUN_LENGTH);
+    input[0] = '#';
+    input[TEST_ITERATION + 1] = 0x7F;
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION + 1);
+}
+
+TEST(scanner, multi_line_comment_run, .iterations=MAX_RUN_LENGTH - 4)
+{
+    const conf_extensions exts = {.c_style_comments = true};
+    const conf_options opts = {.extensions = &exts};
+
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, '*', MAX_RUN_LENGTH);
+    memcpy(input, "/*", 2);
+    memcpy(&input[TEST_ITERATION + 2], "*/", 2);
+    memcpy(&input[MAX_RUN_LENGTH], " x", 3);
+
+    conf_unit *unit = conf_parse(input, &opts, NULL);
+    ASSERT_NONNULL(unit);
+    ASSERT_EQ(conf_get_comment_count(unit), 1);
+    ASSERT_EQ(conf_get_comment(unit, 0)->length, (size_t)TEST_ITERATION + 4);
+    conf_free(unit);
+}
+
+TEST(scanner, quoted_argument_run, .iterations=MAX_RUN_LENGTH - 2)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[0] = '"';
+    input[TEST_ITERATION + 1] = '"';
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument(dir, 0)->lexeme_length, (size_t)TEST_ITERATION + 2);
+    conf_free(unit);
+}
+
+TEST(scanner, quoted_argument_with_new_line, .iterations=MAX_RUN_LENGTH - 2)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[0] = '"';
+    input[TEST_ITERATION + 1] = '\n';
+    memcpy(&input[MAX_RUN_LENGTH], "\"", 2);
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION + 1);
+}
+
+TEST(scanner, triple_quoted_argument_run, .iterations=MAX_RUN_LENGTH - 6)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    memcpy(input, "\"\"\"", 3);
+    input[TEST_ITERATION + 3] = '\n';
+    memcpy(&input[MAX_RUN_LENGTH], "\"\"\"", 4);
+
+    conf_unit *unit = conf_parse(input, NULL, NULL);
+    ASSERT_NONNULL(unit);
+    const conf_directive *dir = conf_get_directive(conf_get_root(unit), 0);
+    ASSERT_EQ(conf_get_argument_count(dir), 1);
+    ASSERT_EQ(conf_get_argument(dir, 0)->lexeme_length, (size_t)MAX_RUN_LENGTH + 3);
+    ASSERT_EQ(conf_get_argument(dir, 0)->value[TEST_ITERATION], '\n');
+    conf_free(unit);
+}
+
+TEST(scanner, triple_quoted_argument_with_control_character, .iterations=MAX_RUN_LENGTH - 3)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    memcpy(input, "\"\"\"", 3);
+    input[TEST_ITERATION + 3] = 0x01;
+    memcpy(&input[MAX_RUN_LENGTH], "\"\"\"", 4);
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION + 3);
+}
+
+TEST(scanner, malformed_sequence_in_ascii_run, .iterations=MAX_RUN_LENGTH)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[TEST_ITERATION] = (char)0xFF;
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_ILLEGAL_BYTE_SEQUENCE, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION);
+}
+
+TEST(scanner, malformed_sequence_in_multi_byte_run, .iterations=MAX_RUN_LENGTH / 3)
+{
+    // Replace the last continuation byte of one character with a byte that is not a continuation byte.
+    char input[MAX_RUN_LENGTH + 16] = {0};
+    for (int i = 0; i < MAX_RUN_LENGTH / 3; i++)
+    {
+        memcpy(&input[i * 3], "\xE3\x81\x82", 3); // U+3042
+    }
+    input[TEST_ITERATION * 3 + 2] = 'a';
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_ILLEGAL_BYTE_SEQUENCE, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION * 3);
+}
+
+TEST(scanner, truncated_sequence_at_end_of_run, .iterations=MAX_RUN_LENGTH - 1)
+{
+    char input[MAX_RUN_LENGTH + 16] = {0};
+    memset(input, 'a', TEST_ITERATION);
+    memcpy(&input[TEST_ITERATION], "\xF0\x9F\x98", 3); // U+1F600 without its last byte
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_ILLEGAL_BYTE_SEQUENCE, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION);
+}
+
+TEST(scanner, syntax_error_precedes_malformed_sequence, .iterations=MAX_RUN_LENGTH - 1)
+{
+    char input[MAX_RUN_LENGTH + 16];
+    memset(input, 'a', MAX_RUN_LENGTH);
+    input[TEST_ITERATION] = '}';
+    input[MAX_RUN_LENGTH - 1] = (char)0xC0;
+    input[MAX_RUN_LENGTH] = '\0';
+
+    conf_error err = {0};
+    ASSERT_NULL(conf_parse(input, NULL, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, err.code);
+    ASSERT_EQ(err.where, (size_t)TEST_ITERATION);
+}
+
+static void assert_same_directives(const conf_directive *expected, const conf_directive *actual)
+{
+    ASSERT_EQ(conf_get_argument_count(expected), conf_get_argument_count(actual));
+    for (long i = 0; i < conf_get_argument_count(expected); i++)
+    {
+        const conf_argument *x = conf_get_argument(expected, i);
+        const conf_argument *y = conf_get_argument(actual, i);
+        ASSERT_STR_EQ(x->value, y->value);
+        ASSERT_EQ(x->lexeme_offset, y->lexeme_offset);
+        ASSERT_EQ(x->lexeme_length, y->lexeme_length);
+    }
+
+    ASSERT_EQ(conf_get_directive_count(expected), conf_get_directive_count(actual));
+    for (long i = 0; i < conf_get_directive_count(expected); i++)
+    {
+        assert_same_directives(conf_get_directive(expected, i), conf_get_directive(actual, i));
+    }
+}
+
+TEST(scanner, force_scalar, .iterations=MAX_RUN_LENGTH)
+{
+    // Build an input where every kind of token spans many block boundaries.
+    static const char *tokens[] = {
+        "argument", "\"quoted argument\"", "\"\"\"triple\nquoted\"\"\"", "\xC3\xA9t\xC3\xA9",
+        "    \t  ", "# comment\n", "\\\n", "{", "}", ";", "\n",
+    };
+    char input[4096] = {0};
+    size_t length = 0;
+    int depth = 0;
+    srand((unsigned)TEST_ITERATION);
+    while (length < sizeof(input) - 64)
+    {
+        const char *token = tokens[rand() % (sizeof(tokens) / sizeof(tokens[0]))];
+        if ((token[0] == '{' && depth > 5) || (token[0] == '}' && depth == 0))
+        {
+            continue;
+        }
+        depth += (token[0] == '{') - (token[0] == '}');
+        length += (size_t)snprintf(&input[length], sizeof(input) - length, "%s ", token);
+    }
+    for (; depth > 0; depth--)
+    {
+        length += (size_t)snprintf(&input[length], sizeof(input) - length, "}");
+    }
+
+    const conf_options scalar_opts = {.force_scalar = true};
+    conf_error scalar_err = {0}, err = {0};
+    conf_unit *scalar_unit = conf_parse(input, &scalar_opts, &scalar_err);
+    conf_unit *unit = conf_parse(input, NULL, &err);
+    ASSERT_EQ(scalar_err.code, err.code);
+    ASSERT_EQ(scalar_err.where, err.where);
+    if (unit != NULL)
+    {
+        ASSERT_NONNULL(scalar_unit);
+        ASSERT_EQ(conf_get_comment_count(scalar_unit), conf_get_comment_count(unit));
+        assert_same_directives(conf_get_root(scalar_unit), conf_get_root(unit));
+        conf_free(unit);
+    }
+    conf_free(scalar_unit);
+}
@@ -153,7 +153,60 @@ static void print_directive(struct StringBuf *sb, struct Directive *dir, int dep
     strbuf_puts(sb, "]");
 }
 
-static char *walk(const char *input, const conf_extensions *extensions)
+// Feeds the input to a stream in chunks of the given length, which exercises resuming the scanner
+// at every position when the chunks are one byte long.
+static conf_errno walk_in_chunks(const char *input, const conf_options *options, conf_error *error, size_t chunk_length)
+{
+    conf_stream *stream = conf_stream_open(options, error, walk_callback);
+    if (stream == NULL)
+    {
+        return error->code;
+    }
+
+    const size_t length = strlen(input);
+    for (size_t i = 0; i < length; i += chunk_length)
+    {
+        const size_t n = (length - i < chunk_length) ? length - i : chunk_length;
+        if (conf_stream_feed(stream, &input[i], n, error) != CONF_NO_ERROR)
+        {
+            break;
+        }
+    }
+
+    const conf_errno code = conf_stream_finish(stream, error);
+    conf_stream_free(stream);
+    return code;
+}
+
+// Reads the elements of the input one at a time and hands them to the walk callback.
+static conf_errno read_events(const char *input, const conf_options *options, conf_error *error)
+{
+    conf_reader *reader = conf_reader_open(input, options, error);
+    if (reader == NULL)
+    {
+        return error->code;
+    }
+
+    conf_event event;
+    while (conf_reader_next(reader, &event))
+    {
+        const conf_comment *comment = (event.element == CONF_COMMENT) ? &event.comment : NULL;
+        walk_callback(options->user_data, event.element, event.argc, event.argv, comment);
+    }
+
+    const conf_errno code = conf_reader_error(reader, error);
+    conf_reader_free(reader);
+    return code;
+}
+
+enum walker
+{
+    WALK_WHOLE, // conf_walk()
+    WALK_STREAMED, // conf_stream_feed() in chunks
+    WALK_READER, // conf_reader_next()
+};
+
+static char *walk(const char *input, const conf_extensions *extensions, enum walker walker, size_t chunk_length)
 {
     conf_error error = {0};
 
@@ -169,7 +222,20 @@ static char *walk(const char *input, const conf_extensions *extensions)
         .extensions = extensions,
     };
 
-    conf_errno code = conf_walk(input, &options, &error, walk_callback);
+    conf_errno code = CONF_NO_ERROR;
+    switch (walker)
+    {
+    case WALK_WHOLE:
+        code = conf_walk(input, &options, &error, walk_callback);
+        break;
+    case WALK_STREAMED:
+        code = walk_in_chunks(input, &options, &error, chunk_length);
+        break;
+    case WALK_READER:
+        code = read_events(input, &options, &error);
+        break;
+    }
+
     if (code != CONF_NO_ERROR)
     {
         strbuf_printf(ud.sb, "error: %s\n", error.description);
@@ -317,7 +383,30 @@ TEST(walker, pretty_print, .iterations=COUNT_OF(tests_utf8))
     const struct TestData *td = &tests_utf8[TEST_ITERATION];
     const char *input = (const char *)td->input;
     const char *output = (const char *)td->output;
-    char *actual = walk(input, &td->extensions);
+    char *actual = walk(input, &td->extensions, WALK_WHOLE, 0);
+    EXPECT_STR_EQ(output, actual, "snapshots do not match: %s", td->name);
+    free(actual);
+}
+
+TEST(walker, pretty_print_streamed, .iterations=COUNT_OF(tests_utf8))
+{
+    const struct TestData *td = &tests_utf8[TEST_ITERATION];
+    const char *input = (const char *)td->input;
+    const char *output = (const char *)td->output;
+    for (size_t chunk_length = 1; chunk_length <= 4; chunk_length++)
+    {
+        char *actual = walk(input, &td->extensions, WALK_STREAMED, chunk_length);
+        EXPECT_STR_EQ(output, actual, "snapshots do not match: %s (chunks of %zu bytes)", td->name, chunk_length);
+        free(actual);
+    }
+}
+
+TEST(walker, pretty_print_with_reader, .iterations=COUNT_OF(tests_utf8))
+{
+    const struct TestData *td = &tests_utf8[TEST_ITERATION];
+    const char *input = (const char *)td->input;
+    const char *output = (const char *)td->output;
+    char *actual = walk(input, &td->extensions, WALK_READER, 0);
     EXPECT_STR_EQ(output, actual, "snapshots do not match: %s", td->name);
     free(actual);
 }
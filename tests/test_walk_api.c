@@ -74,6 +74,170 @@ TEST(conf_walk, low_max_depth)
     ASSERT_STR_EQ("maximum nesting depth exceeded", err.description);
 }
 
+static int count_comments(void *user_data, conf_element elem, int argc, const conf_argument *argv, const conf_comment *comnt)
+{
+    if (elem == CONF_COMMENT)
+    {
+        *(int *)user_data += 1;
+    }
+    return 0;
+}
+
+TEST(conf_walk, discard_comments)
+{
+    int comments = 0;
+    conf_options opts = {.user_data = &comments, .discard_comments = true};
+    ASSERT_EQ(CONF_NO_ERROR, conf_walk("# one\nfoo # two\n", &opts, NULL, count_comments));
+    ASSERT_EQ(comments, 0);
+
+    // Discarded comments must still be well-formed.
+    ASSERT_EQ(CONF_BAD_SYNTAX, conf_walk("# \x01\nfoo\n", &opts, NULL, count_comments));
+}
+
+TEST(conf_walk_n, stops_at_length)
+{
+    conf_error err = {0};
+    ASSERT_EQ(CONF_NO_ERROR, conf_walk_n("foo {", 4, NULL, &err, callback));
+    ASSERT_EQ(CONF_BAD_SYNTAX, conf_walk_n("foo {", 5, NULL, &err, callback));
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_walk_n("foo", 3, NULL, &err, NULL));
+}
+
+TEST(conf_walk_file, walk_file)
+{
+    conf_error err = {0};
+    ASSERT_EQ(CONF_NO_ERROR, conf_walk_file(PATH_TO_CORPUS "/application_settings.conf", NULL, &err, callback));
+    ASSERT_EQ(CONF_IO_ERROR, conf_walk_file(PATH_TO_CORPUS "/does_not_exist.conf", NULL, &err, callback));
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_walk_file(PATH_TO_CORPUS "/application_settings.conf", NULL, &err, NULL));
+}
+
+TEST(conf_stream, null_function_argument)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_stream_open(NULL, &err, NULL));
+    ASSERT_EQ(CONF_INVALID_OPERATION, err.code);
+    ASSERT_STR_EQ("missing function argument", err.description);
+}
+
+TEST(conf_stream, error_offset_is_relative_to_the_stream)
+{
+    conf_error err = {0};
+    conf_stream *stream = conf_stream_open(NULL, &err, callback);
+    ASSERT_NONNULL(stream);
+    ASSERT_EQ(CONF_NO_ERROR, conf_stream_feed(stream, "foo\nba", 6, &err));
+    ASSERT_EQ(CONF_NO_ERROR, conf_stream_feed(stream, "r {\n", 4, &err));
+    ASSERT_EQ(CONF_BAD_SYNTAX, conf_stream_finish(stream, &err));
+    ASSERT_EQ(err.where, 10);
+    ASSERT_STR_EQ("expected '}'", err.description);
+    conf_stream_free(stream);
+}
+
+TEST(conf_stream, feed_after_finish)
+{
+    conf_error err = {0};
+    conf_stream *stream = conf_stream_open(NULL, &err, callback);
+    ASSERT_NONNULL(stream);
+    ASSERT_EQ(CONF_NO_ERROR, conf_stream_feed(stream, "foo", 3, &err));
+    ASSERT_EQ(CONF_NO_ERROR, conf_stream_finish(stream, &err));
+    ASSERT_EQ(err.where, 3);
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_stream_feed(stream, "bar", 3, &err));
+    ASSERT_STR_EQ("stream is finished", err.description);
+    conf_stream_free(stream);
+}
+
+TEST(conf_stream, null_stream_argument)
+{
+    conf_error feed_err = {0};
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_stream_feed(NULL, "foo", 3, &feed_err));
+    ASSERT_EQ(CONF_INVALID_OPERATION, feed_err.code);
+    ASSERT_STR_EQ("missing stream argument", feed_err.description);
+
+    conf_error finish_err = {0};
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_stream_finish(NULL, &finish_err));
+    ASSERT_EQ(CONF_INVALID_OPERATION, finish_err.code);
+    ASSERT_STR_EQ("missing stream argument", finish_err.description);
+
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_stream_feed(NULL, "foo", 3, NULL));
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_stream_finish(NULL, NULL));
+}
+
+TEST(conf_reader, read_events)
+{
+    conf_reader *reader = conf_reader_open("# c\nfoo bar {\n  baz\n}\n", NULL, NULL);
+    ASSERT_NONNULL(reader);
+
+    conf_event event;
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_COMMENT, event.element);
+    ASSERT_EQ(event.comment.offset, 0);
+    ASSERT_EQ(event.comment.length, 3);
+
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_DIRECTIVE, event.element);
+    ASSERT_EQ(event.argc, 2);
+    ASSERT_STR_EQ("foo", event.argv[0].value);
+    ASSERT_STR_EQ("bar", event.argv[1].value);
+
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_BLOCK_ENTER, event.element);
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_DIRECTIVE, event.element);
+    ASSERT_STR_EQ("baz", event.argv[0].value);
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_BLOCK_LEAVE, event.element);
+    ASSERT_FALSE(conf_reader_next(reader, &event));
+
+    conf_error err = {0};
+    ASSERT_EQ(CONF_NO_ERROR, conf_reader_error(reader, &err));
+    conf_reader_free(reader);
+}
+
+TEST(conf_reader, stops_at_error)
+{
+    conf_reader *reader = conf_reader_open("foo\n}\nbar\n", NULL, NULL);
+    ASSERT_NONNULL(reader);
+
+    conf_event event;
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_DIRECTIVE, event.element);
+    ASSERT_FALSE(conf_reader_next(reader, &event));
+    ASSERT_FALSE(conf_reader_next(reader, &event));
+
+    conf_error err = {0};
+    ASSERT_EQ(CONF_BAD_SYNTAX, conf_reader_error(reader, &err));
+    ASSERT_EQ(err.where, 4);
+    ASSERT_STR_EQ("found '}' without matching '{'", err.description);
+    conf_reader_free(reader);
+}
+
+TEST(conf_reader, null_string_argument)
+{
+    conf_error err = {0};
+    ASSERT_NULL(conf_reader_open(NULL, NULL, &err));
+    ASSERT_EQ(CONF_INVALID_OPERATION, err.code);
+}
+
+TEST(conf_reader, null_reader_or_event_argument)
+{
+    conf_event event;
+    ASSERT_FALSE(conf_reader_next(NULL, &event));
+
+    conf_reader *reader = conf_reader_open("foo\n", NULL, NULL);
+    ASSERT_NONNULL(reader);
+    ASSERT_FALSE(conf_reader_next(reader, NULL));
+    ASSERT_TRUE(conf_reader_next(reader, &event));
+    ASSERT_EQ(CONF_DIRECTIVE, event.element);
+    conf_reader_free(reader);
+}
+
+TEST(conf_reader, null_reader_argument_for_error)
+{
+    conf_error err = {0};
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_reader_error(NULL, &err));
+    ASSERT_EQ(CONF_INVALID_OPERATION, err.code);
+    ASSERT_STR_EQ("missing reader argument", err.description);
+    ASSERT_EQ(CONF_INVALID_OPERATION, conf_reader_error(NULL, NULL));
+}
+
 #ifdef DEBUG
 TEST(conf_walk, bad_format_string)
 {
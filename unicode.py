@@ -196,6 +196,41 @@ def compile_table() -> None:
     file.write(source)
     file.close()
 
+    compile_ascii_table()
+
+# The two-stage table lives in its own translation unit which means, without link time optimization,
+# every lookup is a function call. Since most characters are ASCII their flags are duplicated into
+# a small table in a header so they can be looked up inline.
+def compile_ascii_table() -> None:
+    source = 'uint8_t conf_uniflags(uint32_t cp);\n\n'
+
+    source += '// Flag(s) for the ASCII characters, duplicated from the Unicode table for inline lookup.\n'
+    source += 'static const uint8_t conf_asciiflags[128] = {'
+    for cp in range(128):
+        if (cp % 8) == 0:
+            source += '\n'
+            source += '    '
+        source += "{0}, ".format(codepoints[cp])
+    source += '\n'
+    source += '};\n\n'
+
+    source += 'static inline uint8_t conf_charflags(uint32_t cp)\n'
+    source += '{\n'
+    source += '    return (cp < 128) ? conf_asciiflags[cp] : conf_uniflags(cp);\n'
+    source += '}\n\n'
+
+    file = open("confetti_unidata.h", "w", encoding="utf-8")
+    file.write("// Do NOT edit this file. It was programtically generated with {0}.\n".format(os.path.basename(__file__)))
+    file.write("\n")
+    file.write("#ifndef CONFETTI_UNIDATA_H\n")
+    file.write("#define CONFETTI_UNIDATA_H\n")
+    file.write("\n")
+    file.write('#include <stdint.h>\n')
+    file.write("\n")
+    file.write(source)
+    file.write("#endif\n")
+    file.close()
+
 def download_unicode_database() -> None:
     urls = [
         f"https://www.unicode.org/Public/{UNICODE_VERSION}/ucd/UnicodeData.txt",